@@ -16,6 +16,7 @@
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <span>
 #include <type_traits>
@@ -44,6 +45,33 @@ namespace docwire::binary
     }
 #endif
 
+/**
+ * @brief Loads a little-endian integer from the beginning of a byte span with a single unaligned load.
+ * @param data Bytes to load from. It must hold at least sizeof(T) bytes.
+ */
+template <std::integral T>
+T load_little_endian(std::span<const std::byte> data) noexcept
+{
+    T value;
+    std::memcpy(&value, data.data(), sizeof(T));
+    if constexpr (std::endian::native == std::endian::big)
+        return byteswap(value);
+    return value;
+}
+
+/**
+ * @brief Stores an integer as little-endian bytes at the beginning of a byte span.
+ * @param value Integer to store.
+ * @param data Bytes to store to. It must hold at least sizeof(T) bytes.
+ */
+template <std::integral T>
+void store_little_endian(T value, std::span<std::byte> data) noexcept
+{
+    if constexpr (std::endian::native == std::endian::big)
+        value = byteswap(value);
+    std::memcpy(data.data(), &value, sizeof(T));
+}
+
 /**
  * @brief A simple, endian-aware reader for binary data from an abstract source.
  *
@@ -12,57 +12,126 @@
 #include "charset_converter.h"
 
 #include <cstring>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <iconv.h>
+#include <utility>
+#include <vector>
 #include "throw_if.h"
 
 namespace docwire
 {
 
-template<>
-struct pimpl_impl<charset_converter> : pimpl_impl_base
+namespace
+{
+
+struct iconv_descriptor
 {
-	struct iconv_descriptor
+	iconv_t descriptor;
+
+	// The glibc implementation of iconv_open is not entirely thread-safe.
+	// It can race on its internal cache of gconv modules. To prevent this,
+	// we must serialize all calls to iconv_open across all threads.
+	// This mutex is global and static to ensure that only one thread
+	// can be inside iconv_open at any given time. Opened descriptors are
+	// reused through iconv_descriptor_cache, so the lock is only taken
+	// on a cache miss and stays out of the steady-state path.
+	static std::mutex iconv_open_mutex;
+
+	iconv_descriptor(const std::string& from, const std::string& to)
 	{
-		iconv_t descriptor;
-
-		// The glibc implementation of iconv_open is not entirely thread-safe.
-		// It can race on its internal cache of gconv modules. To prevent this,
-		// we must serialize all calls to iconv_open across all threads.
-		// This mutex is global and static to ensure that only one thread
-		// can be inside iconv_open at any given time. The performance impact
-		// is minimal as this lock is only taken once per thread during the
-		// first-time initialization of a charset_converter.
-		static std::mutex iconv_open_mutex;
-
-		iconv_descriptor(const std::string& from, const std::string& to)
-		{
-			std::lock_guard<std::mutex> lock(iconv_open_mutex);
-			descriptor = iconv_open(to.c_str(), from.c_str());
-			throw_if(descriptor == (iconv_t)(-1), "iconv_open() failed", strerror(errno), from, to);
-		}
+		std::lock_guard<std::mutex> lock(iconv_open_mutex);
+		descriptor = iconv_open(to.c_str(), from.c_str());
+		throw_if(descriptor == (iconv_t)(-1), "iconv_open() failed", strerror(errno), from, to);
+	}
+
+	~iconv_descriptor()
+	{
+		if (descriptor != (iconv_t)(-1))
+			iconv_close(descriptor);
+	}
+
+	// iconv_t is a raw C handle, so copying or moving it without proper semantics is unsafe.
+	iconv_descriptor(const iconv_descriptor&) = delete;
+	iconv_descriptor& operator=(const iconv_descriptor&) = delete;
+	iconv_descriptor(iconv_descriptor&&) = delete;
+	iconv_descriptor& operator=(iconv_descriptor&&) = delete;
+};
+
+std::mutex iconv_descriptor::iconv_open_mutex;
+
+// Keeps idle iconv descriptors keyed by (from, to) so that constructing a charset_converter
+// is a lookup instead of an iconv_open call. Every thread owns its own cache, so the lock
+// below is uncontended unless a converter is destroyed on a different thread than the one
+// that created it.
+class iconv_descriptor_cache
+{
+public:
+	using key_type = std::pair<std::string, std::string>;
+
+	static std::shared_ptr<iconv_descriptor_cache> for_current_thread()
+	{
+		thread_local std::shared_ptr<iconv_descriptor_cache> cache = std::make_shared<iconv_descriptor_cache>();
+		return cache;
+	}
 
-		~iconv_descriptor()
+	std::unique_ptr<iconv_descriptor> acquire(const key_type& key)
+	{
 		{
-			if (descriptor != (iconv_t)(-1))
-				iconv_close(descriptor);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_idle.find(key);
+			if (it != m_idle.end() && !it->second.empty())
+			{
+				std::unique_ptr<iconv_descriptor> descriptor = std::move(it->second.back());
+				it->second.pop_back();
+				return descriptor;
+			}
 		}
+		return std::make_unique<iconv_descriptor>(key.first, key.second);
+	}
+
+	void release(const key_type& key, std::unique_ptr<iconv_descriptor> descriptor)
+	{
+		// Return the descriptor to its initial shift state so the next user starts clean.
+		iconv(descriptor->descriptor, nullptr, nullptr, nullptr, nullptr);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::unique_ptr<iconv_descriptor>>& idle = m_idle[key];
+		if (idle.size() < max_idle_per_key)
+			idle.push_back(std::move(descriptor));
+	}
+
+private:
+	// Bounds the cache when many converters for the same pair are alive at once (e.g. nested parsers).
+	static constexpr size_t max_idle_per_key = 4;
+
+	std::mutex m_mutex;
+	std::map<key_type, std::vector<std::unique_ptr<iconv_descriptor>>> m_idle;
+};
 
-		// iconv_t is a raw C handle, so copying or moving it without proper semantics is unsafe.
-		iconv_descriptor(const iconv_descriptor&) = delete;
-		iconv_descriptor& operator=(const iconv_descriptor&) = delete;
-		iconv_descriptor(iconv_descriptor&&) = delete;
-		iconv_descriptor& operator=(iconv_descriptor&&) = delete;
-	};
+} // anonymous namespace
 
+template<>
+struct pimpl_impl<charset_converter> : pimpl_impl_base
+{
 	pimpl_impl(const std::string& from, const std::string& to)
-		: m_descriptor(from, to)
+		: m_key(from, to),
+		  m_cache(iconv_descriptor_cache::for_current_thread()),
+		  m_descriptor(m_cache->acquire(m_key))
 	{}
 
-	iconv_descriptor m_descriptor;
-};
+	~pimpl_impl()
+	{
+		m_cache->release(m_key, std::move(m_descriptor));
+	}
 
-std::mutex pimpl_impl<charset_converter>::iconv_descriptor::iconv_open_mutex;
+	iconv_descriptor_cache::key_type m_key;
+	// Shared ownership keeps the originating cache alive even if this converter outlives its thread.
+	std::shared_ptr<iconv_descriptor_cache> m_cache;
+	std::unique_ptr<iconv_descriptor> m_descriptor;
+	// Trailing bytes of an incomplete multibyte sequence carried over between convert_part() calls.
+	std::string m_pending;
+};
 
 charset_converter::charset_converter(const std::string &from, const std::string &to)
 	: with_pimpl<charset_converter>(from, to)
@@ -71,23 +140,20 @@ charset_converter::charset_converter(const std::string &from, const std::string
 
 charset_converter::~charset_converter() = default;
 
-std::string charset_converter::convert(std::string_view input) const
-{	
-	if (input.empty())
-		return "";
+namespace
+{
 
+// Appends the conversion of as much of the input as possible to the output. Returns the number
+// of trailing input bytes left unconverted because they form an incomplete multibyte sequence.
+size_t convert_into(iconv_t descriptor, std::string_view input, std::string& output)
+{
 	// iconv API is not const-correct for the input buffer.
 	const char* inptr = input.data();
 	size_t inbytesleft = input.length();
 
-	iconv_t descriptor = impl().m_descriptor.descriptor;
-	// Reset descriptor to its initial state for a new conversion.
-	iconv(descriptor, nullptr, nullptr, nullptr, nullptr);
-
 	// A reasonable starting point for most conversions. UTF-8 can take up to 4 bytes per character.
-	size_t output_size = input.length() * 2;
-	std::string output(output_size, '\0');
-	size_t total_written = 0;
+	size_t total_written = output.size();
+	output.resize(total_written + input.length() * 2);
 
 	while (inbytesleft > 0)
 	{
@@ -104,12 +170,51 @@ std::string charset_converter::convert(std::string_view input) const
 				// Double the buffer size and continue.
 				output.resize(output.size() * 2);
 			}
+			else if (errno == EINVAL) // Incomplete multibyte sequence at the end of the input.
+				break;
 			else // A non-recoverable error occurred.
 				throw make_error("iconv() failed", strerror(errno));
 		}
 	}
 	output.resize(total_written);
+	return inbytesleft;
+}
+
+} // anonymous namespace
+
+std::string charset_converter::convert(std::string_view input) const
+{	
+	if (input.empty())
+		return "";
+
+	iconv_t descriptor = impl().m_descriptor->descriptor;
+	// Reset descriptor to its initial state for a new conversion.
+	iconv(descriptor, nullptr, nullptr, nullptr, nullptr);
+
+	std::string output;
+	throw_if(convert_into(descriptor, input, output) > 0, "iconv() failed", strerror(EINVAL));
 	return output;
 }
 
+void charset_converter::convert_part(std::string_view input, bool last, std::string& output)
+{
+	iconv_t descriptor = impl().m_descriptor->descriptor;
+	std::string& pending = impl().m_pending;
+
+	// Complete a multibyte sequence split by the previous part one byte at a time before converting the bulk.
+	while (!pending.empty() && !input.empty())
+	{
+		pending += input.front();
+		input.remove_prefix(1);
+		size_t unconverted = convert_into(descriptor, pending, output);
+		pending.erase(0, pending.size() - unconverted);
+	}
+	if (!input.empty())
+	{
+		size_t unconverted = convert_into(descriptor, input, output);
+		pending.assign(input.substr(input.size() - unconverted));
+	}
+	throw_if(last && !pending.empty(), "iconv() failed", strerror(EINVAL));
+}
+
 } // namespace docwire
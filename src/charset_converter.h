@@ -26,6 +26,17 @@ class DOCWIRE_CORE_EXPORT charset_converter : public with_pimpl<charset_converte
 		charset_converter(const std::string &from, const std::string &to);
 		~charset_converter();
 		std::string convert(std::string_view input) const;
+
+		/**
+		 * @brief Converts the next part of an input that is delivered in chunks and appends the result to output.
+		 *
+		 * Unlike convert(), the conversion state is kept between calls, and trailing bytes of a multibyte
+		 * sequence split between parts are carried over to the next call.
+		 * @param input The next part of the input.
+		 * @param last True if this is the final part of the input.
+		 * @param output The buffer the converted text is appended to.
+		 */
+		void convert_part(std::string_view input, bool last, std::string& output);
 };
 
 } // namespace docwire
@@ -0,0 +1,214 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#ifndef DOCWIRE_CONCURRENT_LRU_CACHE_H
+#define DOCWIRE_CONCURRENT_LRU_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace docwire
+{
+
+/**
+ * @brief Thread-safe Least Recently Used (LRU) cache limited by total weight (e.g. bytes) of values.
+ *
+ * Entries are distributed over independently locked shards by key hash, so threads using different keys
+ * rarely wait for each other. The weight budget is shared by all shards, so a single entry can use all of it.
+ * When the budget is exceeded, least recently used entries of the shard the new entry went to are evicted
+ * first, then those of other shards. Values are returned by copy, so they should be cheap to copy
+ * (e.g. std::shared_ptr). Values are produced outside of locks, so concurrent misses of the same key may
+ * produce the value more than once; the first stored value wins.
+ *
+ * One cache can be shared by all threads of a process, instead of keeping thread_local caches.
+ *
+ * @tparam Key Key type
+ * @tparam Value Value type
+ * @tparam Hash Hash function of keys
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class concurrent_lru_cache
+{
+public:
+    /// Returns weight of an entry, in the same unit as the budget.
+    using weight_function = std::function<size_t(const Key&, const Value&)>;
+
+    /// Cache activity since construction.
+    struct statistics
+    {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+        size_t weight;
+    };
+
+    /**
+     * @brief Constructs cache with specified weight budget.
+     * @param max_weight Maximum total weight of entries
+     * @param weight Function returning weight of an entry. Entries heavier than the whole budget are not stored.
+     * @param shard_count Number of independently locked parts of the cache
+     */
+    concurrent_lru_cache(size_t max_weight, weight_function weight, size_t shard_count = 16)
+        : m_max_weight{max_weight}, m_weight{std::move(weight)}, m_shards(std::max<size_t>(shard_count, 1))
+    {}
+
+    /**
+     * @brief Returns value for specified key or std::nullopt if key is not in the cache.
+     * @param key Key for which value is requested
+     */
+    std::optional<Value> find(const Key& key)
+    {
+        shard& s = shard_for(key);
+        std::lock_guard<std::mutex> lock{s.mutex};
+        auto it = s.index.find(key);
+        if (it == s.index.end())
+        {
+            ++m_misses;
+            return std::nullopt;
+        }
+        ++m_hits;
+        s.entries.splice(s.entries.begin(), s.entries, it->second);
+        return it->second->value;
+    }
+
+    /**
+     * @brief Returns value for specified key. If key is not in the cache, it calls producer function
+     *        to create value for the key and stores it.
+     * @param key Key for which value is requested
+     * @param producer Function that creates value for specified key if key is not in the cache
+     */
+    Value get_or_create(const Key& key, const std::function<Value(const Key&)>& producer)
+    {
+        if (std::optional<Value> value = find(key))
+            return std::move(*value);
+        return insert(key, producer(key), false);
+    }
+
+    /**
+     * @brief Stores value for specified key, replacing the previous one if key is already in the cache.
+     * @param key Key to store value for
+     * @param value Value to store
+     */
+    void put(const Key& key, const Value& value)
+    {
+        insert(key, value, true);
+    }
+
+    /// Returns cache activity since construction.
+    statistics get_statistics() const
+    {
+        statistics result{m_hits, m_misses, m_evictions, 0, 0};
+        for (const shard& s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock{s.mutex};
+            result.entries += s.entries.size();
+            result.weight += s.weight;
+        }
+        return result;
+    }
+
+private:
+    struct entry
+    {
+        Key key;
+        Value value;
+        size_t weight;
+    };
+
+    struct shard
+    {
+        mutable std::mutex mutex;
+        std::list<entry> entries;
+        std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index;
+        size_t weight = 0;
+    };
+
+    shard& shard_for(const Key& key)
+    {
+        return m_shards[Hash{}(key) % m_shards.size()];
+    }
+
+    Value insert(const Key& key, const Value& value, bool replace)
+    {
+        size_t weight = m_weight(key, value);
+        shard& s = shard_for(key);
+        // Evicted values are destroyed after the locks are released.
+        std::vector<entry> evicted;
+        {
+            std::lock_guard<std::mutex> lock{s.mutex};
+            auto it = s.index.find(key);
+            if (it != s.index.end())
+            {
+                if (!replace)
+                {
+                    s.entries.splice(s.entries.begin(), s.entries, it->second);
+                    return it->second->value;
+                }
+                s.weight -= it->second->weight;
+                m_total_weight -= it->second->weight;
+                evicted.push_back(std::move(*it->second));
+                s.entries.erase(it->second);
+                s.index.erase(it);
+            }
+            if (weight > m_max_weight)
+                return value;
+            s.entries.push_front(entry{key, value, weight});
+            s.index.emplace(key, s.entries.begin());
+            s.weight += weight;
+            m_total_weight += weight;
+            while (m_total_weight > m_max_weight && s.entries.size() > 1)
+                evict_oldest(s, evicted);
+        }
+        // Only one shard is locked at a time, so inserting threads never wait for each other in a cycle.
+        for (size_t i = 0; i < m_shards.size() && m_total_weight > m_max_weight; ++i)
+        {
+            shard& other = m_shards[m_next_evicted_shard++ % m_shards.size()];
+            if (&other == &s)
+                continue;
+            std::lock_guard<std::mutex> lock{other.mutex};
+            while (m_total_weight > m_max_weight && !other.entries.empty())
+                evict_oldest(other, evicted);
+        }
+        return value;
+    }
+
+    void evict_oldest(shard& s, std::vector<entry>& evicted)
+    {
+        entry& oldest = s.entries.back();
+        s.weight -= oldest.weight;
+        m_total_weight -= oldest.weight;
+        s.index.erase(oldest.key);
+        evicted.push_back(std::move(oldest));
+        s.entries.pop_back();
+        ++m_evictions;
+    }
+
+    size_t m_max_weight;
+    weight_function m_weight;
+    std::vector<shard> m_shards;
+    std::atomic<size_t> m_total_weight = 0;
+    std::atomic<size_t> m_next_evicted_shard = 0;
+    std::atomic<size_t> m_hits = 0;
+    std::atomic<size_t> m_misses = 0;
+    std::atomic<size_t> m_evictions = 0;
+};
+
+} // namespace docwire
+
+#endif // DOCWIRE_CONCURRENT_LRU_CACHE_H
@@ -229,6 +229,14 @@ void data_source::fill_memory_cache(std::optional<length_limit> limit) const
 				if (!m_memory_cache)
 					m_memory_cache = std::make_shared<memory_buffer>(0);
 				read_unseekable_stream_into_memory(m_memory_cache, source.v, limit);
+			},
+			[this](const memory_buffer_producer& source)
+			{
+				if (!m_memory_cache)
+				{
+					m_memory_cache = source.v();
+					throw_if (!m_memory_cache, "Memory buffer producer returned no data");
+				}
 			}
 		},
 		m_source
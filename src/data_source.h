@@ -40,6 +40,18 @@ struct unseekable_stream_ptr
   std::shared_ptr<std::istream> v;
 };
 
+/**
+ * @brief Wrapper for a function producing the content in memory on first access.
+ *
+ * Allows a parser to emit a data_source whose bytes are expensive to produce (e.g. an encoded image
+ * or a compressed attachment) and to do the work only if a consumer actually reads the data.
+ * The function is called at most once per data_source object and its result becomes the memory cache.
+ */
+struct memory_buffer_producer
+{
+  std::function<std::shared_ptr<memory_buffer>()> v;
+};
+
 /// Wrapper for a length limit value.
 struct length_limit
 {
@@ -96,7 +108,8 @@ concept data_source_compatible_type =
 	std::is_same_v<T, std::string> ||
 	std::is_same_v<T, std::string_view> ||
 	std::is_same_v<T, seekable_stream_ptr> ||
-	std::is_same_v<T, unseekable_stream_ptr>;
+	std::is_same_v<T, unseekable_stream_ptr> ||
+	std::is_same_v<T, memory_buffer_producer>;
 
 /**
  * @brief Concept matching reference-qualified types compatible with data_source.
@@ -308,7 +321,7 @@ class DOCWIRE_CORE_EXPORT data_source
 		std::unordered_map<mime_type, confidence> mime_types;
 
 	private:
-		std::variant<std::filesystem::path, std::vector<std::byte>, std::span<const std::byte>, std::string, std::string_view, seekable_stream_ptr, unseekable_stream_ptr> m_source;
+		std::variant<std::filesystem::path, std::vector<std::byte>, std::span<const std::byte>, std::string, std::string_view, seekable_stream_ptr, unseekable_stream_ptr, memory_buffer_producer> m_source;
 		std::optional<docwire::file_extension> m_file_extension;
 		mutable std::shared_ptr<memory_buffer> m_memory_cache;
 		mutable std::shared_ptr<std::istream> m_path_stream;
@@ -13,9 +13,9 @@
 
 #include "document_elements.h"
 #include "error_tags.h"
-#include "log_cerr_redirection.h"
 #include "log_entry.h"
 #include "log_scope.h"
+#include "log_tags.h"
 #include "misc.h"
 #include "nested_exception.h"
 #include "throw_if.h"
@@ -23,12 +23,13 @@
 #include "wv2/src/parser9x.h"
 #include "wv2/src/fields.h"
 #include "wv2/src/handlers.h"
-#include <mutex>
 #include "oshared.h"
 #include "wv2/src/paragraphproperties.h"
 #include "wv2/src/parserfactory.h"
+#include <sstream>
 #include <stdio.h>
 #include "wv2/src/ustring.h"
+#include "wv2/src/wvlog.h"
 #include <vector>
 #ifdef WIN32
 	#include <windows.h>
@@ -48,8 +49,37 @@ using namespace wvWare;
 
 namespace
 {
-	std::mutex parser_factory_mutex_1;
-	std::mutex parser_factory_mutex_2;
+
+/**
+ * @brief Collects diagnostic output that wv2 writes on the current thread and logs it when destroyed.
+ *
+ * Unlike log::cerr_redirection it does not swap the buffer of std::cerr, so it does not need a process-wide
+ * lock and documents can be parsed by many threads at once.
+ */
+class wv2_diagnostics_capture
+{
+public:
+	explicit wv2_diagnostics_capture(const source_location& location = source_location::current())
+		: m_location{location}, m_capture{m_diagnostics}
+	{}
+
+	wv2_diagnostics_capture(const wv2_diagnostics_capture&) = delete;
+	wv2_diagnostics_capture& operator=(const wv2_diagnostics_capture&) = delete;
+
+	~wv2_diagnostics_capture()
+	{
+	#ifndef NDEBUG
+		std::string diagnostics = m_diagnostics.str();
+		if (log::detail::is_logging_enabled() && !diagnostics.empty())
+			log::entry(m_location, std::make_tuple(log::stderr_redirect{}, serialization::object{{{"redirected_cerr", diagnostics}}}));
+	#endif
+	}
+
+private:
+	source_location m_location;
+	std::ostringstream m_diagnostics;
+	WvLogCapture m_capture;
+};
 
 const std::vector<mime_type> supported_mime_types =
 {
@@ -270,6 +300,7 @@ static void parse_comments(const wvWare::Parser* parser, std::vector<comment>& c
 				comment c;
 				c.fc = stream_offset;
 				c.text = annotations[i];
+				std::replace(c.text.begin(), c.text.end(), '\x0b', '\n');
 				comments.push_back(c);
 			}
 		}
@@ -299,6 +330,19 @@ class text_handler : public wvWare::TextHandler
 		bool m_comments_parsed;
 		std::vector<comment> m_comments;
 		U32 m_prev_par_fc;
+		std::string m_text_buffer; // reused for UTF-8 conversion of every text run
+
+		void append_text(const UString& text)
+		{
+			append_utf16_as_utf8(m_text_buffer, std::span<const UChar>(text.data(), text.length()), true);
+		}
+
+		void emit_text()
+		{
+			document::text text{.text = m_text_buffer};
+			m_text_buffer.clear();
+			m_emit_message(std::move(text));
+		}
 
 	public:
 		text_handler(const message_callbacks& emit_message, const wvWare::Parser* parser, current_state* curr_state)
@@ -346,9 +390,7 @@ class text_handler : public wvWare::TextHandler
 					for (int i = 0; i < m_comments.size(); i++)
 					if (m_comments[i].fc >= m_prev_par_fc && m_comments[i].fc < ((Parser9x*)m_parser)->currentParagraph()->back().m_startFC)
 					{
-						std::string comment_text = m_comments[i].text;
-						std::replace(comment_text.begin(), comment_text.end(), '\x0b', '\n');
-						m_emit_message(document::comment{.author = m_comments[i].author, .comment = comment_text});
+						m_emit_message(document::comment{.author = m_comments[i].author, .comment = m_comments[i].text});
 					}
 				}
 				else
@@ -386,9 +428,8 @@ class text_handler : public wvWare::TextHandler
 				m_curr_state->field_value += text;
 			else
 			{
-				std::string t = ustring_to_string(text);
-				std::replace(t.begin(), t.end(), '\x0b', '\n');
-				m_emit_message(document::text{.text = t});
+				append_text(text);
+				emit_text();
 			}
 		}
 
@@ -459,11 +500,12 @@ class text_handler : public wvWare::TextHandler
 			}
 			while (i < params.length() && params[i] == ' ') i++;
 			params = params.substr(i);
-			UString res_text;
 			switch (m_curr_state->field_type)
 			{
 				case FLT_FILLIN:
-					res_text = params + UString(" ") + m_curr_state->field_value;
+					append_text(params);
+					m_text_buffer += ' ';
+					append_text(m_curr_state->field_value);
 					break;
 				case FLT_EMBED:
 					break;
@@ -478,16 +520,18 @@ class text_handler : public wvWare::TextHandler
 						m_emit_message(document::close_link{});
 					}
 					else
-						res_text = params + UString(" ") + m_curr_state->field_value;
+					{
+						append_text(params);
+						m_text_buffer += ' ';
+						append_text(m_curr_state->field_value);
+					}
 					break;
 				default:
-					res_text = m_curr_state->field_value;
+					append_text(m_curr_state->field_value);
 			}
 			m_curr_state->field_type = FLT_NONE;
 			m_curr_state->field_part = FIELD_PART_NONE;
-			std::string t = ustring_to_string(res_text);
-			std::replace(t.begin(), t.end(), '\x0b', '\n');
-			m_emit_message(document::text{.text = t});
+			emit_text();
 		}
 
 		void endOfDocument()
@@ -497,9 +541,7 @@ class text_handler : public wvWare::TextHandler
 				for (int i = 0; i < m_comments.size(); i++)
 					if (m_comments[i].fc >= m_prev_par_fc)
 					{
-						std::string comment_text = m_comments[i].text;
-						std::replace(comment_text.begin(), comment_text.end(), '\x0b', '\n');
-						m_emit_message(document::comment{.author = m_comments[i].author, .comment = comment_text});
+						m_emit_message(document::comment{.author = m_comments[i].author, .comment = m_comments[i].text});
 					}
 		}
 };
@@ -661,13 +703,8 @@ void pimpl_impl<doc_parser>::parse(const data_source& data, const message_callba
 	}
 	storage->leaveDirectory();
 	curr_state.obj_texts_iter = curr_state.obj_texts.begin();
-	log::cerr_redirection cerr_redirection;
-	SharedPtr<wvWare::Parser> parser;
-	{
-		std::lock_guard<std::mutex> parser_factory_mutex_2_lock(parser_factory_mutex_2);
-		parser = ParserFactory::createParser(storage.release()); //storage will be deleted inside parser from wv2 library
-	}
-	cerr_redirection.restore();
+	wv2_diagnostics_capture wv2_diagnostics;
+	SharedPtr<wvWare::Parser> parser = ParserFactory::createParser(storage.release()); //storage will be deleted inside parser from wv2 library
 	throw_if (!parser, "Error while creating parser");
 	throw_if (!parser->isOk() && parser->fib().fEncrypted, errors::file_encrypted{});
 	throw_if (!parser->isOk(), "Error while creating parser", errors::uninterpretable_data{});
@@ -677,9 +714,7 @@ void pimpl_impl<doc_parser>::parse(const data_source& data, const message_callba
 	parser->setTableHandler(&table_handler);
 	subdocument_handler subdocument_handler(emit_message, &curr_state.header_footer);
 	parser->setSubDocumentHandler(&subdocument_handler);
-	cerr_redirection.redirect();
 	bool res = parser->parse();
-	cerr_redirection.restore();
 	throw_if (!res, "parse() failed", errors::uninterpretable_data{});
 	text_handler.endOfDocument();
 	emit_message(document::close_document{});
@@ -16,6 +16,7 @@
 #include "core_export.h"
 #include "data_source.h"
 #include "message.h"
+#include "raster_image.h"
 #include <functional>
 #include <optional>
 #include <string>
@@ -122,6 +123,7 @@ struct DOCWIRE_CORE_EXPORT image
   attributes::position position; ///< Positional attributes.
   attributes::styling styling;
   std::optional<message_sequence_streamer> structured_content_streamer;
+  std::optional<raster_image_provider> raster; ///< Provides decoded pixels, if the parser can. Consumers should prefer it over decoding the source.
 };
 
 struct DOCWIRE_CORE_EXPORT style
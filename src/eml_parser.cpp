@@ -55,6 +55,7 @@ template<>
 struct pimpl_impl<eml_parser> : pimpl_impl_base
 {
 	std::stack<context> m_context_stack;
+	mail_filter m_filter;
 
 	template <typename T>
 	continuation emit_message(T&& object) const
@@ -164,7 +165,6 @@ struct pimpl_impl<eml_parser> : pimpl_impl_base
 		else if (ct.media_type() != mime::media_type_t::MULTIPART)
 		{
 			log_scope();
-			std::string plain = mime_entity.content();
 			std::string file_name = mime_entity.name();
 			std::optional<std::string> attachment_name;
 			std::optional<file_extension> extension;
@@ -176,19 +176,23 @@ struct pimpl_impl<eml_parser> : pimpl_impl_base
 			}
 
 			log_entry(attachment_name);
-			auto result = emit_message(mail::attachment{.name = attachment_name, .size = plain.length(), .extension = extension});
-			if (result != continuation::skip)
+			if (m_filter.accepts_attachment(extension))
 			{
-				try
-				{
-					emit_message_back(data_source { plain, mime_type_from_mime_entity(mime_entity), confidence::very_high});
-				}
-				catch (std::exception&)
+				std::string plain = mime_entity.content();
+				auto result = emit_message(mail::attachment{.name = attachment_name, .size = plain.length(), .extension = extension});
+				if (result != continuation::skip)
 				{
-					emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process attachment", file_name)));
+					try
+					{
+						emit_message_back(data_source { plain, mime_type_from_mime_entity(mime_entity), confidence::very_high});
+					}
+					catch (std::exception&)
+					{
+						emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process attachment", file_name)));
+					}
+					emit_message(mail::close_attachment{});
 				}
 			}
-			emit_message(mail::close_attachment{});
 		}
 
 		if (ct.media_subtype() == "alternative")
@@ -249,7 +253,10 @@ struct pimpl_impl<eml_parser> : pimpl_impl_base
 	}
 };
 
-eml_parser::eml_parser() = default;
+eml_parser::eml_parser(mail_filter filter)
+{
+	impl().m_filter = std::move(filter);
+}
 
 namespace
 {
@@ -434,6 +441,30 @@ mailio::message parse_message(const data_source& data, const std::function<void(
 	return mime_entity;
 }
 
+// Parses the header only, up to and including the empty line that ends it.
+// Errors are ignored: a message without a readable date is accepted by mail_filter and parsed in full.
+mailio::message parse_message_header(const data_source& data)
+{
+	log_scope(data);
+	std::shared_ptr<std::istream> stream = data.istream();
+	mailio::message mime_entity;
+	mime_entity.line_policy(codec::line_len_policy_t::NONE);
+	try {
+		std::string line;
+		while (std::getline(*stream, line))
+		{
+			normalize_line(line);
+			mime_entity.parse_by_line(line);
+			if (line.empty())
+				break;
+		}
+	} catch (std::exception&)
+	{
+		log_entry();
+	}
+	return mime_entity;
+}
+
 const std::vector<mime_type> supported_mime_types =
 {
 	mime_type{"message/rfc822"}
@@ -445,6 +476,7 @@ namespace
 {
 
 attributes::metadata metaData(const mailio::message& mime_entity);
+std::optional<unsigned int> creation_time(const mailio::message& mime_entity);
 
 } // anonymous namespace
 
@@ -461,6 +493,12 @@ continuation eml_parser::operator()(message_ptr msg, const message_callbacks& em
 		return emit_message(std::move(msg));
 
 	log_entry();
+	const mail_filter& filter = impl().m_filter;
+	if (filter.has_creation_time_range() && !filter.accepts_creation_time(creation_time(parse_message_header(data))))
+	{
+		log_entry();
+		return continuation::proceed;
+	}
 	try
 	{
 		message_counters counters;
@@ -508,6 +546,14 @@ std::optional<std::chrono::sys_seconds> convert_impl(const mailio_time& ldt, con
 	}
 }
 
+std::optional<unsigned int> creation_time(const mailio::message& mime_entity)
+{
+	std::optional<std::chrono::sys_seconds> date = convert::try_to<std::chrono::sys_seconds>(mailio_time{mime_entity.date_time()});
+	if (!date)
+		return std::nullopt;
+	return static_cast<unsigned int>(date->time_since_epoch().count());
+}
+
 attributes::metadata metaData(const mailio::message& mime_entity)
 {
 	log_scope();
@@ -15,6 +15,7 @@
 #include "mail_export.h"
 
 #include "chain_element.h"
+#include "mail_filter.h"
 #include "pimpl.h"
 
 namespace docwire
@@ -27,7 +28,7 @@ class DOCWIRE_MAIL_EXPORT eml_parser : public chain_element, public with_pimpl<e
 		friend pimpl_impl<eml_parser>;
 
 	public:
-		eml_parser();
+		eml_parser(mail_filter filter = {});
 		continuation operator()(message_ptr msg, const message_callbacks& emit_message) override;
 		bool is_leaf() const override { return false; }
 };
@@ -0,0 +1,93 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#ifndef DOCWIRE_LEPTONICA_RASTER_IMAGE_H
+#define DOCWIRE_LEPTONICA_RASTER_IMAGE_H
+
+#include "error_tags.h"
+#include <leptonica/allheaders.h>
+#include "log_scope.h"
+#include "make_error.h"
+#include <memory>
+#include "raster_image.h"
+#include "throw_if.h"
+
+namespace docwire
+{
+
+using pix_unique_ptr = std::unique_ptr<PIX, decltype([](PIX* pix) { pixDestroy(&pix); })>;
+
+/// Copies raster_image pixels into a new Leptonica PIX (8 bpp for grayscale, 32 bpp RGBA otherwise).
+inline pix_unique_ptr pix_from_raster_image(const raster_image& image)
+{
+	log_scope(image.width, image.height, image.stride, image.horizontal_dpi, image.vertical_dpi);
+	throw_if(!image.pixels, "Raster image has no pixel data", errors::program_logic{});
+	throw_if(image.width <= 0 || image.height <= 0 || image.pixels->size() < static_cast<size_t>(image.stride) * image.height,
+		"Raster image dimensions do not match pixel data", image.width, image.height, image.stride, image.pixels->size(), errors::uninterpretable_data{});
+	const unsigned char* pixels = reinterpret_cast<const unsigned char*>(image.pixels->data());
+	pix_unique_ptr pix;
+
+	if (image.format == pixel_format::gray8)
+	{
+		pix = pix_unique_ptr{pixCreate(image.width, image.height, 8)};
+		throw_if(!pix, "pixCreate failed for grayscale");
+		pixSetXRes(pix.get(), image.horizontal_dpi);
+		pixSetYRes(pix.get(), image.vertical_dpi);
+
+		l_uint32 wpl = pixGetWpl(pix.get());
+		l_uint32* pix_data = pixGetData(pix.get());
+		for (int y = 0; y < image.height; ++y)
+		{
+			l_uint32* line = pix_data + y * wpl;
+			const unsigned char* src_line = pixels + y * image.stride;
+			for (int x = 0; x < image.width; ++x)
+				SET_DATA_BYTE(line, x, src_line[x]);
+		}
+	}
+	else
+	{
+		pix = pix_unique_ptr{pixCreate(image.width, image.height, 32)};
+		throw_if (!pix, "pixCreate failed for BGR/BGRx/BGRA");
+		pixSetXRes(pix.get(), image.horizontal_dpi);
+		pixSetYRes(pix.get(), image.vertical_dpi);
+		bool has_alpha = image.format == pixel_format::bgra32;
+		if (has_alpha)
+			pixSetSpp(pix.get(), 4);
+
+		int bytes_per_pixel = (image.format == pixel_format::bgr24) ? 3 : 4;
+		l_uint32 wpl = pixGetWpl(pix.get());
+		l_uint32* pix_data = pixGetData(pix.get());
+		for (int y = 0; y < image.height; ++y)
+		{
+			const unsigned char* src_line = pixels + y * image.stride;
+			l_uint32* line = pix_data + y * wpl;
+			for (int x = 0; x < image.width; ++x)
+			{
+				l_uint8 b = src_line[x * bytes_per_pixel + 0];
+				l_uint8 g = src_line[x * bytes_per_pixel + 1];
+				l_uint8 r = src_line[x * bytes_per_pixel + 2];
+				l_uint8 a = has_alpha ? src_line[x * bytes_per_pixel + 3] : 255;
+				l_uint32 rgba_pixel = 0;
+				throw_if(
+					composeRGBAPixel(r, g, b, a, &rgba_pixel) != 0,
+					"composeRGBAPixel failed",
+					x, y
+				);
+				line[x] = rgba_pixel;
+			}
+		}
+	}
+	return pix;
+}
+
+} // namespace docwire
+
+#endif // DOCWIRE_LEPTONICA_RASTER_IMAGE_H
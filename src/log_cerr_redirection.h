@@ -13,16 +13,13 @@
 #define DOCWIRE_LOG_CERR_REDIRECTION_H
 
 #include "core_export.h"
+#include "log_tags.h" // IWYU pragma: export
 #include "pimpl.h"
 #include "source_location.h"
-#include <string_view>
 
 namespace docwire::log
 {
 
-/// @brief Tag for log entries that contain content redirected from `stderr`.
-struct DOCWIRE_CORE_EXPORT stderr_redirect { static constexpr std::string_view string() { return "stderr_redirect"; } };
-
 class DOCWIRE_CORE_EXPORT cerr_redirection : public with_pimpl<cerr_redirection>
 {
 public:
@@ -44,6 +44,9 @@ struct DOCWIRE_CORE_EXPORT scope_exit { static constexpr std::string_view string
  */
 struct DOCWIRE_CORE_EXPORT return_value { static constexpr std::string_view string() { return "return"; } };
 
+/// @brief Tag for log entries that contain content redirected from `stderr`.
+struct DOCWIRE_CORE_EXPORT stderr_redirect { static constexpr std::string_view string() { return "stderr_redirect"; } };
+
 } // namespace docwire::log
 
 #endif // DOCWIRE_LOG_TAGS_H
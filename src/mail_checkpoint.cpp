@@ -0,0 +1,89 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#include "mail_checkpoint.h"
+
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include "log_scope.h"
+#include "serialization_filesystem.h" // IWYU pragma: keep
+#include "throw_if.h"
+
+namespace docwire
+{
+
+template<>
+struct pimpl_impl<file_mail_checkpoint_store> : pimpl_impl_base
+{
+	pimpl_impl(const std::filesystem::path& path)
+		: m_path(path)
+	{
+		log_scope(path);
+		if (std::filesystem::exists(path))
+		{
+			std::ifstream input{path, std::ios::binary};
+			throw_if (!input.good(), "Cannot open checkpoint file", path);
+			std::string contents{std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{}};
+			size_t line_start = 0;
+			for (size_t line_end = contents.find('\n'); line_end != std::string::npos; line_end = contents.find('\n', line_start))
+			{
+				if (line_end > line_start)
+				{
+					std::uint32_t identifier;
+					auto result = std::from_chars(contents.data() + line_start, contents.data() + line_end, identifier);
+					throw_if (result.ec != std::errc{} || result.ptr != contents.data() + line_end, "Invalid checkpoint file line", path, line_start);
+					m_identifiers.insert(identifier);
+				}
+				line_start = line_end + 1;
+			}
+			// The last commit was interrupted before its line was complete
+			if (line_start < contents.size())
+			{
+				input.close();
+				std::filesystem::resize_file(path, line_start);
+			}
+		}
+		m_output.open(path, std::ios::binary | std::ios::app);
+		throw_if (!m_output.good(), "Cannot open checkpoint file for writing", path);
+	}
+
+	std::filesystem::path m_path;
+	std::unordered_set<std::uint32_t> m_identifiers;
+	std::ofstream m_output;
+	mutable std::mutex m_mutex;
+};
+
+file_mail_checkpoint_store::file_mail_checkpoint_store(const std::filesystem::path& path)
+	: with_pimpl<file_mail_checkpoint_store>(path)
+{
+}
+
+bool file_mail_checkpoint_store::contains(std::uint32_t identifier) const
+{
+	std::lock_guard<std::mutex> lock{impl().m_mutex};
+	return impl().m_identifiers.contains(identifier);
+}
+
+void file_mail_checkpoint_store::commit(std::uint32_t identifier)
+{
+	std::lock_guard<std::mutex> lock{impl().m_mutex};
+	if (!impl().m_identifiers.insert(identifier).second)
+		return;
+	impl().m_output << identifier << '\n';
+	impl().m_output.flush();
+	throw_if (!impl().m_output.good(), "Cannot write checkpoint file", impl().m_path);
+}
+
+} // namespace docwire
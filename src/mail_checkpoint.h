@@ -0,0 +1,69 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#ifndef DOCWIRE_MAIL_CHECKPOINT_H
+#define DOCWIRE_MAIL_CHECKPOINT_H
+
+#include "mail_export.h"
+
+#include "pimpl.h"
+#include <cstdint>
+#include <filesystem>
+
+namespace docwire
+{
+
+/**
+ * @brief Persistent set of identifiers of mailbox items that were already processed.
+ *
+ * Passed to pst_parser to resume an interrupted extraction, or to extract only messages added since the previous run.
+ * The parser skips messages the store contains and commits every other message after all of its content was emitted,
+ * so a message is committed only when downstream processing of it has finished. Messages skipped downstream or with
+ * a body or attachment that failed to process are not committed, so the next run processes them again. Identifiers are unique within one
+ * mailbox file only, so every mailbox needs its own store. Mailboxes attached inside the parsed one do not use it.
+ */
+class DOCWIRE_MAIL_EXPORT mail_checkpoint_store
+{
+public:
+  virtual ~mail_checkpoint_store() = default;
+
+  /// Returns true if the item was committed in this or a previous run.
+  virtual bool contains(std::uint32_t identifier) const = 0;
+
+  /// Records the item as processed.
+  virtual void commit(std::uint32_t identifier) = 0;
+};
+
+/**
+ * @brief Checkpoint store kept in a text file with one identifier per line.
+ *
+ * Every commit is appended and flushed immediately. A last line cut short by a crash is removed when the file is loaded.
+ */
+class DOCWIRE_MAIL_EXPORT file_mail_checkpoint_store : public mail_checkpoint_store, public with_pimpl<file_mail_checkpoint_store>
+{
+private:
+  using with_pimpl<file_mail_checkpoint_store>::impl;
+  friend pimpl_impl<file_mail_checkpoint_store>;
+
+public:
+  /**
+   * @brief Loads identifiers committed by previous runs. The file is created if it does not exist.
+   * @param path Path of the checkpoint file
+   */
+  explicit file_mail_checkpoint_store(const std::filesystem::path& path);
+
+  bool contains(std::uint32_t identifier) const override;
+  void commit(std::uint32_t identifier) override;
+};
+
+} // namespace docwire
+
+#endif // DOCWIRE_MAIL_CHECKPOINT_H
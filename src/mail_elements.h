@@ -29,6 +29,7 @@ struct DOCWIRE_CORE_EXPORT mail
   std::optional<std::string> subject;
   std::optional<std::uint32_t> date;
   std::optional<int> level;
+  std::optional<std::uint32_t> identifier; ///< Stable identifier of the item within the mailbox, if the format has one.
 };
 
 struct DOCWIRE_CORE_EXPORT close_mail {};
@@ -49,6 +50,7 @@ struct DOCWIRE_CORE_EXPORT folder
 {
   std::optional<std::string> name;
   std::optional<int> level;
+  std::optional<std::uint32_t> identifier; ///< Stable identifier of the item within the mailbox, if the format has one.
 };
 
 struct DOCWIRE_CORE_EXPORT close_folder { };
@@ -0,0 +1,62 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#ifndef DOCWIRE_MAIL_FILTER_H
+#define DOCWIRE_MAIL_FILTER_H
+
+#include "file_extension.h"
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace docwire
+{
+
+/**
+ * @brief Predicates evaluated by mail parsers on header fields, before bodies and attachments are read.
+ *
+ * Fields match the standard_filter functions of the same purpose, but items they reject are not read at all
+ * and the parser emits no messages for them. A mail outside of the creation time range is skipped with all its
+ * attachments. Unset fields accept everything.
+ */
+struct mail_filter
+{
+  std::optional<std::vector<std::string>> folder_names; ///< Like standard_filter::filterByFolderName().
+  std::optional<std::vector<file_extension>> attachment_types; ///< Like standard_filter::filterByAttachmentType().
+  std::optional<unsigned int> min_creation_time; ///< Like standard_filter::filterByMailMinCreationTime().
+  std::optional<unsigned int> max_creation_time; ///< Like standard_filter::filterByMailMaxCreationTime().
+
+  bool accepts_folder(const std::string& name) const
+  {
+    return !folder_names || std::find(folder_names->begin(), folder_names->end(), name) != folder_names->end();
+  }
+
+  bool accepts_attachment(const std::optional<file_extension>& extension) const
+  {
+    return !attachment_types || !extension ||
+      std::find(attachment_types->begin(), attachment_types->end(), *extension) != attachment_types->end();
+  }
+
+  bool has_creation_time_range() const
+  {
+    return min_creation_time || max_creation_time;
+  }
+
+  bool accepts_creation_time(std::optional<unsigned int> time) const
+  {
+    return !time || ((!min_creation_time || *time >= *min_creation_time) && (!max_creation_time || *time <= *max_creation_time));
+  }
+};
+
+} // namespace docwire
+
+#endif // DOCWIRE_MAIL_FILTER_H
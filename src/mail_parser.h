@@ -22,8 +22,9 @@ namespace docwire
 class mail_parser : public parsing_chain
 {
     public:
-        mail_parser()
-            : parsing_chain{eml_parser{} | pst_parser{}}
+        mail_parser(pst_parallelism pst_parallelism_arg = {}, const mail_filter& mail_filter_arg = {},
+                    std::shared_ptr<mail_checkpoint_store> mail_checkpoint_store_arg = nullptr)
+            : parsing_chain{eml_parser{mail_filter_arg} | pst_parser{pst_parallelism_arg, mail_filter_arg, mail_checkpoint_store_arg}}
         {}
 };
 
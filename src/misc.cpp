@@ -25,19 +25,44 @@ namespace docwire
 std::string ustring_to_string(const UString& s)
 {
 	log_scope();
-	const UChar* src = s.data();
-	int length = s.length();
 	std::string r;
-	int index = 0;
-	while (index < length)
+	append_utf16_as_utf8(r, std::span<const UChar>(s.data(), s.length()));
+	return r;
+}
+
+void append_utf16_as_utf8(std::string& out, std::span<const UChar> text, bool vertical_tab_as_newline)
+{
+	// Worst case is 3 UTF-8 bytes per UTF-16 unit (surrogate pairs take 4 bytes for 2 units)
+	out.reserve(out.size() + text.size() * 3);
+	for (size_t index = 0; index < text.size(); ++index)
 	{
-		unsigned int ch = src[index++].unicode();
-		if (utf16_unichar_has_4_bytes(ch) && index < length)
-			ch = (ch << 16) + src[index++].unicode();
-		if (ch != 0)
-			r += unichar_to_utf8(ch);
+		unsigned int ch = text[index].unicode();
+		if (ch < 0x80)
+		{
+			if (ch == 0)
+				continue;
+			out += (vertical_tab_as_newline && ch == '\x0b') ? '\n' : static_cast<char>(ch);
+		}
+		else if (ch < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (ch >> 6));
+			out += static_cast<char>(0x80 | (ch & 0x3F));
+		}
+		else if (utf16_unichar_has_4_bytes(ch) && index + 1 < text.size())
+		{
+			ch = (((ch & 0x3FF) << 10) | (text[++index].unicode() & 0x3FF)) + 0x10000;
+			out += static_cast<char>(0xF0 | (ch >> 18));
+			out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (ch & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xE0 | (ch >> 12));
+			out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (ch & 0x3F));
+		}
 	}
-	return r;
 }
 
 std::string unichar_to_utf8(unsigned int unichar)
@@ -14,6 +14,7 @@
 
 #include "core_export.h"
 #include "data_source.h"
+#include <span>
 #include <string>
 #include <vector>
 #include "wv2/src/ustring.h"
@@ -35,6 +36,13 @@ DOCWIRE_CORE_EXPORT std::string formatNumberedList(std::vector<std::string>& mli
 
 DOCWIRE_CORE_EXPORT std::string ustring_to_string(const UString& s);
 
+/**
+	Appends UTF-16 text to a UTF-8 string in place, without temporary strings per character.
+	Null characters are skipped like in ustring_to_string(). If vertical_tab_as_newline is set,
+	vertical tabs (manual line breaks in Word documents) are written as '\n'.
+*/
+DOCWIRE_CORE_EXPORT void append_utf16_as_utf8(std::string& out, std::span<const UChar> text, bool vertical_tab_as_newline = false);
+
 DOCWIRE_CORE_EXPORT UString utf8_to_ustring(const std::string& src);
 
 DOCWIRE_CORE_EXPORT std::string unichar_to_utf8(unsigned int unichar);
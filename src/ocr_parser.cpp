@@ -13,32 +13,54 @@
 
 #include "document_elements.h"
 #include "error_tags.h"
-#include <leptonica/allheaders.h>
+#include "leptonica_raster_image.h"
 #include <leptonica/array_internal.h>
 #include <leptonica/pix_internal.h>
-#include <stack>
+#include <map>
+#include <semaphore>
+#include <shared_mutex>
 #include <tesseract/baseapi.h>
 #include <tesseract/ocrclass.h>
 
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "binary_reader.h"
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include "concurrent_lru_cache.h"
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <iomanip>
 #include <cstdlib>
 #include <magic_enum/magic_enum_iostream.hpp>
 #include "log_entry.h"
 #include "log_scope.h"
-#include "lru_memory_cache.h"
 #include <mutex>
 #include "nested_exception.h"
 #include <numeric>
+#include <sstream>
+#include <thread>
 #include "resource_path.h"
 #include "serialization_data_source.h" // IWYU pragma: keep
 #include "serialization_enum.h" // IWYU pragma: keep
 #include "serialization_message.h" // IWYU pragma: keep
-#include "scoped_stack_push.h"
 #include <tesseract/resultiterator.h>
 #include "throw_if.h"
+#ifdef _WIN32
+	#include <process.h>
+#else
+	#include <unistd.h>
+#endif
 
 namespace docwire
 {
@@ -46,18 +68,23 @@ namespace docwire
 namespace
 {
 
+// Captures Leptonica error messages of the current thread.
+// The handler is installed once for the process and never replaced, so threads do not race on it.
+// Messages of threads without an active capturer go to stderr, as they would without the handler.
 class leptonica_stderr_capturer
 {
 public:
     leptonica_stderr_capturer()
     {
+        static std::once_flag handler_installed;
+        std::call_once(handler_installed, []() { leptSetStderrHandler(stderr_handler); });
         m_contents.clear();
-        leptSetStderrHandler(stderr_handler);
+        m_active = true;
     }
 
     ~leptonica_stderr_capturer()
     {
-        leptSetStderrHandler(nullptr);
+        m_active = false;
     }
 
     std::string contents()
@@ -68,17 +95,33 @@ public:
 private:
     static void stderr_handler(const char* msg)
     {
-        m_contents += msg;
+        if (m_active)
+            m_contents += msg;
+        else
+            fputs(msg, stderr);
     }
 
     static thread_local std::string m_contents;
+    static thread_local bool m_active;
 };
 
 thread_local std::string leptonica_stderr_capturer::m_contents;
+thread_local bool leptonica_stderr_capturer::m_active = false;
 
 struct context
 {
     const message_callbacks& emit_message;
+    bool cancelled = false;
+};
+
+// Recognition of an image started in the background when the image passes through the parser.
+struct deferred_recognition
+{
+    std::shared_future<std::vector<message_ptr>> recognized;
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+
+    // Streamers of images that are dropped downstream are never called, so their recognition is not needed.
+    ~deferred_recognition() { *cancelled = true; }
 };
 
 } // anonymous namespace
@@ -91,29 +134,75 @@ struct pimpl_impl<ocr_parser> : with_pimpl_owner<ocr_parser>
     ocr_confidence_threshold m_ocr_confidence_threshold;
     ocr_timeout m_ocr_timeout;
     ocr_data_path m_ocr_data_path;
-    std::stack<context> m_context_stack;
+    ocr_concurrency m_ocr_concurrency;
+    ocr_prefilter m_ocr_prefilter;
+    ocr_downscaling m_ocr_downscaling;
+    ocr_result_cache m_ocr_result_cache;
+    ocr_region_parallelism m_ocr_region_parallelism;
+    std::atomic<size_t> m_recognized_images = 0;
+    std::atomic<size_t> m_skipped_too_small_images = 0;
+    std::atomic<size_t> m_skipped_blank_images = 0;
+    std::atomic<size_t> m_skipped_images_without_components = 0;
+    // Limits images being recognized in the background. Present only if concurrency is above 1.
+    std::unique_ptr<std::counting_semaphore<>> m_in_flight_images;
+    std::ptrdiff_t m_max_in_flight_images = 0;
+    // Images being recognized in the background and the text following them, held back so that the next images
+    // are recognized while the consumer waits for the first one. Only held inside a document, which closes them.
+    std::deque<message_ptr> m_held_messages;
+    size_t m_open_documents = 0;
 
-    template <typename T>
-	continuation emit_message(T&& object) const
-	{
-		return m_context_stack.top().emit_message(std::forward<T>(object));
-	}
+    ~pimpl_impl()
+    {
+        // Held images are never read, so their recognition is cancelled.
+        m_held_messages.clear();
+        // Background recognitions use the parser, so wait for all of them to finish.
+        if (m_in_flight_images)
+            for (std::ptrdiff_t i = 0; i < m_max_in_flight_images; ++i)
+                m_in_flight_images->acquire();
+    }
+
+    // Emits the held messages up to the second held image, or all of them.
+    continuation emit_held_messages(const message_callbacks& emit_message, bool all)
+    {
+        bool image_emitted = false;
+        while (!m_held_messages.empty() && (all || !image_emitted || !m_held_messages.front()->is<document::image>()))
+        {
+            message_ptr msg = std::move(m_held_messages.front());
+            m_held_messages.pop_front();
+            image_emitted = image_emitted || msg->is<document::image>();
+            if (emit_message(std::move(msg)) == continuation::stop)
+            {
+                m_held_messages.clear();
+                return continuation::stop;
+            }
+        }
+        return continuation::proceed;
+    }
 
     static bool cancel (void* data, int words)
     {
         auto context_ptr = reinterpret_cast<context*>(data);
-        return context_ptr->emit_message(ocr::please_wait{}) == continuation::stop;
+        context_ptr->cancelled = context_ptr->cancelled || context_ptr->emit_message(ocr::please_wait{}) == continuation::stop;
+        return context_ptr->cancelled;
     }
 };  
 
+// Always returns a new image, never a clone, because the input can be shared by threads through the image cache
+// and Leptonica reference counting is not thread safe.
 Pix* pixToGrayscale(Pix* pix)
 {
     log_scope();
     Pix* output{};
     switch(pix->d)
     {
+    case 1:
+    case 2:
+    case 4:
+        // Fax scans (CCITT G3 and G4) are 1 bpp, palette images can be 2 or 4 bpp.
+        output = pixConvertTo8(pix, 0);
+        break;
     case 8:
-        output = pixRemoveColormap(pix, REMOVE_CMAP_TO_GRAYSCALE); 
+        output = pixGetColormap(pix) ? pixRemoveColormap(pix, REMOVE_CMAP_TO_GRAYSCALE) : pixCopy(nullptr, pix);
         break;
     case 16:
         {
@@ -124,9 +213,14 @@ Pix* pixToGrayscale(Pix* pix)
         }
     case 32:
         {
-            auto tmp = pixRemoveAlpha(pix);
-            output = pixConvertRGBToGrayFast(tmp);
-            pixDestroy(&tmp);
+            if (pixGetSpp(pix) == 4)
+            {
+                auto tmp = pixRemoveAlpha(pix);
+                output = pixConvertRGBToGrayFast(tmp);
+                pixDestroy(&tmp);
+            }
+            else
+                output = pixConvertRGBToGrayFast(pix);
             break;	
         }
     default:
@@ -176,27 +270,165 @@ namespace
         delete tessAPI;
     };
     using tessAPIWrapper = std::unique_ptr<TessBaseAPI, decltype(tessAPIDeleter)>;
+
+    std::mutex tesseract_libtiff_mutex;
+
+struct tesseract_engine_key
+{
+    std::string data_path;
+    std::string languages;
+    tesseract::OcrEngineMode engine_mode;
+    auto operator<=>(const tesseract_engine_key&) const = default;
+};
+
+// Process-wide pool of initialized Tesseract engines.
+// Loading traineddata is the most expensive part of OCR, so every engine is initialized once
+// per (data path, languages, engine mode) and reused. Recognition results are cleared when
+// an engine is returned to the pool.
+class tesseract_engine_pool
+{
+private:
+    struct idle_engines
+    {
+        std::mutex mutex;
+        std::vector<tessAPIWrapper> engines;
+    };
+
+public:
+    // Engine checked out of the pool. It goes back to the pool when the lease is destroyed.
+    class lease
+    {
+    public:
+        lease(idle_engines& idle, tessAPIWrapper engine)
+            : m_idle{&idle}, m_engine{std::move(engine)}
+        {}
+
+        lease(lease&&) = default;
+        lease& operator=(lease&&) = delete;
+
+        ~lease()
+        {
+            if (m_engine)
+                release(*m_idle, std::move(m_engine));
+        }
+
+        TessBaseAPI* operator->() const { return m_engine.get(); }
+        TessBaseAPI& operator*() const { return *m_engine; }
+
+    private:
+        idle_engines* m_idle;
+        tessAPIWrapper m_engine;
+    };
+
+    static tesseract_engine_pool& instance()
+    {
+        // Never destroyed: engines must not outlive Tesseract's own static data at exit.
+        static tesseract_engine_pool* pool = new tesseract_engine_pool;
+        return *pool;
+    }
+
+    lease acquire(const tesseract_engine_key& key)
+    {
+        log_scope(key.data_path, key.languages);
+        idle_engines& idle = idle_engines_for(key);
+        {
+            std::lock_guard<std::mutex> lock{idle.mutex};
+            if (!idle.engines.empty())
+            {
+                tessAPIWrapper engine = std::move(idle.engines.back());
+                idle.engines.pop_back();
+                return lease{idle, std::move(engine)};
+            }
+        }
+        log_entry();
+        tessAPIWrapper engine{new TessBaseAPI{}, tessAPIDeleter};
+        {
+            // Initialization touches libtiff state shared with image decoding. It runs only when the pool has no idle engine.
+            std::lock_guard<std::mutex> lock{tesseract_libtiff_mutex};
+            throw_if (engine->Init(key.data_path.c_str(), key.languages.c_str(), key.engine_mode) != 0,
+                "Could not initialize tesseract", key.data_path, key.languages);
+        }
+        return lease{idle, std::move(engine)};
+    }
+
+private:
+    idle_engines& idle_engines_for(const tesseract_engine_key& key)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock{m_mutex};
+            auto it = m_idle_engines.find(key);
+            if (it != m_idle_engines.end())
+                return *it->second;
+        }
+        std::lock_guard<std::shared_mutex> lock{m_mutex};
+        auto& idle = m_idle_engines[key];
+        if (!idle)
+            idle = std::make_unique<idle_engines>();
+        return *idle;
+    }
+
+    static void release(idle_engines& idle, tessAPIWrapper engine)
+    {
+        engine->Clear();
+        engine->ClearAdaptiveClassifier();
+        // More idle engines than threads that can use them at once would only hold memory.
+        const size_t max_idle_engines = std::max(1u, std::thread::hardware_concurrency());
+        std::lock_guard<std::mutex> lock{idle.mutex};
+        if (idle.engines.size() < max_idle_engines)
+            idle.engines.push_back(std::move(engine));
+        else
+        {
+            log_entry(max_idle_engines);
+        }
+    }
+
+    std::shared_mutex m_mutex;
+    std::map<tesseract_engine_key, std::unique_ptr<idle_engines>> m_idle_engines;
+};
 }
 
 using magic_enum::ostream_operators::operator<<;
 
 namespace
 {
-    std::mutex tesseract_libtiff_mutex;
 
-    using pix_unique_ptr = std::unique_ptr<PIX, decltype([](PIX* pix) { pixDestroy(&pix); })>;
+bool is_tiff_format(l_int32 format)
+{
+    switch (format)
+    {
+        case IFF_TIFF: case IFF_TIFF_PACKBITS: case IFF_TIFF_RLE: case IFF_TIFF_G3: case IFF_TIFF_G4:
+        case IFF_TIFF_LZW: case IFF_TIFF_ZIP: case IFF_TIFF_JPEG:
+            return true;
+        default:
+            return false;
+    }
+}
 
 std::shared_ptr<PIX> load_pix(const data_source& data)
 {
     log_scope(data);
-    static thread_local lru_memory_cache<unique_identifier, std::shared_ptr<PIX>> pix_cache;
-    
+    // Shared by all threads. Images are only read, never cloned, after they are stored.
+    static concurrent_lru_cache<unique_identifier, std::shared_ptr<PIX>> pix_cache{
+        256 * 1024 * 1024,
+        [](const unique_identifier&, const std::shared_ptr<PIX>& pix)
+        {
+            return static_cast<size_t>(pixGetWpl(pix.get())) * sizeof(l_uint32) * pixGetHeight(pix.get());
+        }};
+
     return pix_cache.get_or_create(data.id(),
         [&data](const unique_identifier& key)
         {
-            std::lock_guard<std::mutex> lock { tesseract_libtiff_mutex };
             leptonica_stderr_capturer leptonica_stderr_capturer;
             std::optional<std::filesystem::path> path = data.path();
+            l_int32 format = IFF_UNKNOWN;
+            if (path)
+                findFileFormat(path->string().c_str(), &format);
+            else if (data.span().size() >= 12) // findFileFormatBuffer reads the first 12 bytes unchecked
+                findFileFormatBuffer(reinterpret_cast<const l_uint8*>(data.span().data()), &format);
+            // Other decoders keep their state per call, so only TIFF decoding is serialized.
+            std::unique_lock<std::mutex> lock { tesseract_libtiff_mutex, std::defer_lock };
+            if (is_tiff_format(format))
+                lock.lock();
             PIX* pix;
             if (path)
             {
@@ -212,6 +444,94 @@ std::shared_ptr<PIX> load_pix(const data_source& data)
         });
 }
 
+// Returns the image downscaled to the limits or nullptr if it is within them.
+// Resolution is taken from the image (e.g. set by pdf_parser from the PDF image metadata).
+pix_unique_ptr downscale(PIX* pix, const ocr_downscaling& limits)
+{
+    log_scope();
+    float scale = 1.0f;
+    l_int32 dpi = std::max(pixGetXRes(pix), pixGetYRes(pix));
+    if (limits.target_dpi && dpi > *limits.target_dpi)
+        scale = static_cast<float>(*limits.target_dpi) / dpi;
+    double pixels = static_cast<double>(pixGetWidth(pix)) * pixGetHeight(pix);
+    if (limits.max_pixels && pixels * scale * scale > *limits.max_pixels)
+        scale = static_cast<float>(std::sqrt(*limits.max_pixels / pixels));
+    log_entry(dpi, pixels, scale);
+    if (scale >= 1.0f)
+        return pix_unique_ptr{ nullptr };
+    // pixScale picks area mapping for large reductions and updates the resolution accordingly.
+    pix_unique_ptr scaled{ pixScale(pix, scale, scale) };
+    throw_if(!scaled, "pixScale failed", scale);
+    return scaled;
+}
+
+using shade_histogram = std::array<double, 256>; // 0 - black, 255 - white
+
+// Global Otsu threshold: the shade that best separates the histogram into ink and background.
+int otsu_threshold(const shade_histogram& histogram, double total, double shade_sum)
+{
+    double background_weight = 0;
+    double background_sum = 0;
+    double best_variance = -1;
+    int threshold = 0;
+    for (int i = 0; i < static_cast<int>(histogram.size()); ++i)
+    {
+        background_weight += histogram[i];
+        if (background_weight == 0)
+            continue;
+        double foreground_weight = total - background_weight;
+        if (foreground_weight == 0)
+            break;
+        background_sum += i * histogram[i];
+        double background_mean = background_sum / background_weight;
+        double foreground_mean = (shade_sum - background_sum) / foreground_weight;
+        double variance = background_weight * foreground_weight * (background_mean - foreground_mean) * (background_mean - foreground_mean);
+        if (variance > best_variance)
+        {
+            best_variance = variance;
+            threshold = i;
+        }
+    }
+    return threshold;
+}
+
+enum class prefilter_verdict { recognize, too_small, blank, without_components };
+
+// Decides from cheap statistics whether an image with dark text on light background can contain text at all.
+prefilter_verdict prefilter(PIX* text_image, const shade_histogram& histogram, const ocr_prefilter& thresholds)
+{
+    log_scope();
+    if (pixGetWidth(text_image) < thresholds.min_width || pixGetHeight(text_image) < thresholds.min_height)
+        return prefilter_verdict::too_small;
+    double total = 0;
+    double shade_sum = 0;
+    for (size_t i = 0; i < histogram.size(); ++i)
+    {
+        total += histogram[i];
+        shade_sum += i * histogram[i];
+    }
+    if (total == 0)
+        return prefilter_verdict::blank;
+    double mean = shade_sum / total;
+    double variance = 0;
+    for (size_t i = 0; i < histogram.size(); ++i)
+        variance += histogram[i] * (i - mean) * (i - mean);
+    variance /= total;
+    int threshold = otsu_threshold(histogram, total, shade_sum);
+    double ink = std::accumulate(histogram.begin(), histogram.begin() + threshold + 1, 0.0);
+    log_entry(variance, threshold, ink / total);
+    if (variance < thresholds.min_gray_variance || ink / total < thresholds.min_ink_ratio)
+        return prefilter_verdict::blank;
+    pix_unique_ptr binary{ pixThresholdToBinary(text_image, threshold + 1) };
+    throw_if(!binary, "pixThresholdToBinary failed");
+    l_int32 components = 0;
+    throw_if(pixCountConnComp(binary.get(), 8, &components) != 0, "pixCountConnComp failed");
+    log_entry(components);
+    if (components < thresholds.min_components)
+        return prefilter_verdict::without_components;
+    return prefilter_verdict::recognize;
+}
+
 ocr_data_path default_tessdata_path()
 {
     log_scope();
@@ -233,112 +553,244 @@ const std::vector<mime_type> supported_mime_types
     mime_type{"image/webp"}
 };
 
-} // anonymous namespace
+// Recognized text of an image in the order of emission, independent of message objects so that it can be
+// cached and replayed any number of times.
+struct recognized_element
+{
+    enum class kind : char
+    {
+        section = 's', paragraph = 'p', text = 't', break_line = 'b', close_paragraph = 'P', close_section = 'S'
+    };
+    kind type;
+    std::string text;
+};
 
-ocr_parser::ocr_parser(const std::vector<language>& languages,
-                     ocr_confidence_threshold ocr_confidence_threshold_arg,
-                     ocr_timeout ocr_timeout_arg,
-                     ocr_data_path ocr_data_path_arg)
+using recognition_result = std::vector<recognized_element>;
+
+void emit_recognized(const recognition_result& result, const message_callbacks& emit_message)
 {
-    log_scope(languages, ocr_confidence_threshold_arg, ocr_timeout_arg, ocr_data_path_arg);
-    impl().m_languages = languages;
-    impl().m_ocr_confidence_threshold = ocr_confidence_threshold_arg;
-    impl().m_ocr_timeout = ocr_timeout_arg;
-    impl().m_ocr_data_path = ocr_data_path_arg.v.empty() ? default_tessdata_path() : ocr_data_path_arg;
+    for (const recognized_element& element : result)
+    {
+        switch (element.type)
+        {
+            case recognized_element::kind::section: emit_message(document::section{}); break;
+            case recognized_element::kind::paragraph: emit_message(document::paragraph{}); break;
+            case recognized_element::kind::text: emit_message(document::text{element.text}); break;
+            case recognized_element::kind::break_line: emit_message(document::break_line{}); break;
+            case recognized_element::kind::close_paragraph: emit_message(document::close_paragraph{}); break;
+            case recognized_element::kind::close_section: emit_message(document::close_section{}); break;
+        }
+    }
 }
 
-void ocr_parser::parse(const data_source& data, const std::vector<language>& languages)
+// Stable 128-bit hash of the image pixels and recognition parameters. It does not depend on the process
+// or platform, so it can name files of the on-disk cache.
+class recognition_key_hasher
 {
-    log_scope(data, languages);
-
-    tessAPIWrapper api{ nullptr, tessAPIDeleter };
-    try
+public:
+    void add(uint64_t word)
     {
-        api.reset(new TessBaseAPI{});
+        m_h1 = (m_h1 ^ word) * 0x100000001b3ull;
+        m_h2 = std::rotl(m_h2 + word * 0x9e3779b97f4a7c15ull, 31) * 0xc2b2ae3d27d4eb4full;
     }
-    catch(const std::bad_alloc& exc)
+
+    void add(std::string_view text)
     {
-        throw;
+        add(text.size());
+        for (char c : text)
+            add(static_cast<unsigned char>(c));
     }
 
-    std::string langs = std::accumulate(languages.begin(), languages.end(), std::string{},
-      [](const std::string& acc, const language& lang)
-      {
-        return acc + (acc.empty() ? "" : "+") + boost::lexical_cast<std::string>(lang);
-      });
-    log_entry(langs);
+    // Hashes width bytes of every row of an 8 bpp image, skipping the padding at the end of rows.
+    void add_pixels(PIX* pix)
+    {
+        l_int32 width = pixGetWidth(pix);
+        l_int32 height = pixGetHeight(pix);
+        l_int32 wpl = pixGetWpl(pix);
+        add((static_cast<uint64_t>(width) << 32) | static_cast<uint32_t>(height));
+        const l_uint32* row = pixGetData(pix);
+        l_int32 full_words = width / 4;
+        l_int32 remaining_bytes = width % 4;
+        // The first pixel of a word is in its most significant byte.
+        l_uint32 last_word_mask = remaining_bytes ? ~l_uint32{0} << (32 - 8 * remaining_bytes) : 0;
+        for (l_int32 y = 0; y < height; ++y, row += wpl)
+        {
+            for (l_int32 x = 0; x < full_words; ++x)
+                add(row[x]);
+            if (remaining_bytes)
+                add(row[full_words] & last_word_mask);
+        }
+    }
 
+    std::string hex_digest() const
     {
-        std::lock_guard<std::mutex> tesseract_libtiff_mutex_lock{ tesseract_libtiff_mutex };
-        throw_if (api->Init(impl().m_ocr_data_path.v.string().c_str(), langs.c_str()) != 0,
-            "Could not initialize tesseract", impl().m_ocr_data_path.v.string(), langs);
+        std::ostringstream stream;
+        stream << std::hex << std::setfill('0') << std::setw(16) << m_h1 << std::setw(16) << m_h2;
+        return stream.str();
     }
 
-    // Read the image and convert to a gray-scale image
-    pix_unique_ptr gray{ nullptr };
+private:
+    uint64_t m_h1 = 0xcbf29ce484222325ull;
+    uint64_t m_h2 = 0x84222325cbf29ce4ull;
+};
 
-    std::shared_ptr<PIX> image = load_pix(data);
+// Process-wide cache of recognition results, so recurring images (logos, stamps, signatures) are recognized once.
+// Results can also be kept in a directory to be shared between processes and runs.
+class recognition_result_cache
+{
+public:
+    static recognition_result_cache& instance()
+    {
+        static recognition_result_cache cache;
+        return cache;
+    }
 
-    pix_unique_ptr inverted{ nullptr };
-    try
+    std::shared_ptr<const recognition_result> find(const std::string& key, const ocr_result_cache& options)
     {
-        gray.reset(pixToGrayscale(image.get()));
-        std::unique_ptr<NUMA, decltype([](NUMA* numa) { numaDestroy(&numa); })> histogram{ pixGetGrayHistogram(gray.get(), 1) };
+        if (options.in_memory)
+            if (std::optional<std::shared_ptr<const recognition_result>> result = m_memory_cache.find(key))
+                return *result;
+        if (!options.directory)
+            return nullptr;
+        std::shared_ptr<const recognition_result> result = read_file(*options.directory / (key + ".ocr"));
+        if (result && options.in_memory)
+            m_memory_cache.put(key, result);
+        return result;
+    }
 
-        double weight_sum{ 0 };
-        double sum{ 0 };
+    void put(const std::string& key, std::shared_ptr<const recognition_result> result, const ocr_result_cache& options)
+    {
+        if (options.in_memory)
+            m_memory_cache.put(key, result);
+        if (const std::optional<std::filesystem::path>& directory = options.directory)
+            write_file(*directory, key, *result);
+    }
 
-        constexpr int shadeScale{ 256 }; // where 0 - black, 255 - white
-        for(int i{ 0 }; i < shadeScale; ++i)
+private:
+    static constexpr size_t max_memory_size = 64 * 1024 * 1024;
+    static constexpr std::string_view file_signature = "docwire-ocr-2\n";
+
+    static bool is_valid_kind(char type)
+    {
+        switch (static_cast<recognized_element::kind>(type))
         {
-            // calculating weighted average of shade
-            sum += (i+1) * histogram->array[i];
-            weight_sum += histogram->array[i];
+            case recognized_element::kind::section: case recognized_element::kind::paragraph:
+            case recognized_element::kind::text: case recognized_element::kind::break_line:
+            case recognized_element::kind::close_paragraph: case recognized_element::kind::close_section:
+                return true;
         }
+        return false;
+    }
 
-        if(static_cast<int>(sum / weight_sum) <= shadeScale / 2)
+    // File format: signature, then for every element its kind, text size (32-bit, little-endian) and text.
+    // Files can be corrupted or truncated, so nothing read from them is trusted.
+    static std::shared_ptr<const recognition_result> read_file(const std::filesystem::path& path)
+    {
+        std::ifstream file{path, std::ios::binary};
+        if (!file)
+            return nullptr;
+        std::string contents{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        if (!contents.starts_with(file_signature))
         {
-            inverted.reset(pixInvert(nullptr, gray.get()));
+            log_entry(path);
+            return nullptr;
         }
-        else
+        auto result = std::make_shared<recognition_result>();
+        std::string_view remaining{contents};
+        remaining.remove_prefix(file_signature.size());
+        while (!remaining.empty())
         {
-            inverted.reset(gray.release());
+            uint32_t size;
+            if (!is_valid_kind(remaining.front()) || remaining.size() < 1 + sizeof(size))
+            {
+                log_entry(path);
+                return nullptr;
+            }
+            recognized_element element{static_cast<recognized_element::kind>(remaining.front())};
+            size = binary::load_little_endian<uint32_t>(std::as_bytes(std::span{remaining.data() + 1, sizeof(size)}));
+            remaining.remove_prefix(1 + sizeof(size));
+            if (size > remaining.size())
+            {
+                log_entry(path, size);
+                return nullptr;
+            }
+            element.text = remaining.substr(0, size);
+            remaining.remove_prefix(size);
+            result->push_back(std::move(element));
         }
+        return result;
     }
-    catch(const std::exception& e)
+
+    // Process and thread id, so that writers in different processes sharing the directory do not collide.
+    static std::string temporary_file_suffix()
     {
-        throw;
+        std::ostringstream suffix;
+#ifdef _WIN32
+        suffix << _getpid();
+#else
+        suffix << getpid();
+#endif
+        suffix << "." << std::this_thread::get_id() << ".tmp";
+        return suffix.str();
     }
 
-    api->SetImage(inverted.get());
-    tesseract::ETEXT_DESC monitor;
-    if (impl().m_ocr_timeout.v)
+    // Written to a temporary file first, so concurrent readers never see a partially written result.
+    static void write_file(const std::filesystem::path& directory, const std::string& key, const recognition_result& result)
     {
-        monitor.set_deadline_msecs(*impl().m_ocr_timeout.v);
+        log_scope(directory, key);
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::filesystem::path temporary_path = directory / (key + "." + temporary_file_suffix());
+        {
+            std::ofstream file{temporary_path, std::ios::binary | std::ios::trunc};
+            file.write(file_signature.data(), file_signature.size());
+            for (const recognized_element& element : result)
+            {
+                uint32_t size = static_cast<uint32_t>(element.text.size());
+                std::array<std::byte, sizeof(size)> size_bytes;
+                binary::store_little_endian(size, size_bytes);
+                file.put(static_cast<char>(element.type));
+                file.write(reinterpret_cast<const char*>(size_bytes.data()), size_bytes.size());
+                file.write(element.text.data(), size);
+            }
+            if (!file)
+            {
+                log_entry(temporary_path);
+                file.close();
+                std::filesystem::remove(temporary_path, error);
+                return;
+            }
+        }
+        std::filesystem::rename(temporary_path, directory / (key + ".ocr"), error);
+        if (error)
+        {
+            log_entry(error.message());
+            std::filesystem::remove(temporary_path, error);
+        }
     }
-    monitor.cancel = &pimpl_impl<ocr_parser>::cancel;
-    monitor.cancel_this = reinterpret_cast<void*>(&impl().m_context_stack.top());
 
-    // Recognize the image
-    api->Recognize(&monitor);
-
-    // Iterate through results and emit messages: Block -> Paragraph -> Line -> Word
-    const float confidence_threshold = impl().m_ocr_confidence_threshold.v.value_or(75.0f);
-
-    std::unique_ptr<tesseract::ResultIterator> rit(api->GetIterator());
-    if (!rit) {
-        log_entry();
-        return;
-    }
+    concurrent_lru_cache<std::string, std::shared_ptr<const recognition_result>> m_memory_cache{
+        max_memory_size,
+        [](const std::string& key, const std::shared_ptr<const recognition_result>& result)
+        {
+            size_t size = key.size() + sizeof(recognition_result);
+            for (const recognized_element& element : *result)
+                size += sizeof(recognized_element) + element.text.size();
+            return size;
+        }};
+};
 
-    rit->Begin(); // Start at page level
+// Collects recognized text: Block -> Paragraph -> Line -> Word
+void collect_recognized(tesseract::ResultIterator& rit, float confidence_threshold, recognition_result& result)
+{
+    rit.Begin(); // Start at page level
     do { // Iterate Blocks (RIL_BLOCK)
-        // TODO: Add styling attributes from rit->BoundingBox(RIL_BLOCK, ...) if needed
-        impl().emit_message(document::section{});
+        // TODO: Add styling attributes from rit.BoundingBox(RIL_BLOCK, ...) if needed
+        result.push_back({recognized_element::kind::section});
 
         do { // Iterate Paragraphs (RIL_PARA) within the current Block
-            // TODO: Add styling attributes from rit->BoundingBox(RIL_PARA, ...) if needed
-            impl().emit_message(document::paragraph{});
+            // TODO: Add styling attributes from rit.BoundingBox(RIL_PARA, ...) if needed
+            result.push_back({recognized_element::kind::paragraph});
             bool current_line_had_high_confidence_text = false; // Used for BreakLine logic
 
             do { // Iterate TextLines (RIL_TEXTLINE) within the current Paragraph
@@ -346,7 +798,7 @@ void ocr_parser::parse(const data_source& data, const std::vector<language>& lan
                 bool previous_word_on_line_was_high_confidence = false; // For spacing between words
 
                 do { // Iterate Words (RIL_WORD) within the current TextLine
-                    const char* word_chars = rit->GetUTF8Text(tesseract::RIL_WORD);
+                    const char* word_chars = rit.GetUTF8Text(tesseract::RIL_WORD);
                     std::string current_word_str;
                     if (word_chars)
                     {
@@ -355,12 +807,12 @@ void ocr_parser::parse(const data_source& data, const std::vector<language>& lan
                         boost::algorithm::trim(current_word_str);
                     }
                     if (!current_word_str.empty()) {
-                        float conf = rit->Confidence(tesseract::RIL_WORD);
+                        float conf = rit.Confidence(tesseract::RIL_WORD);
                         if (conf >= confidence_threshold) {
                             if (previous_word_on_line_was_high_confidence) {
-                                impl().emit_message(document::text{" "}); // Add space before the current word
+                                result.push_back({recognized_element::kind::text, " "}); // Add space before the current word
                             }
-                            impl().emit_message(document::text{current_word_str});
+                            result.push_back({recognized_element::kind::text, current_word_str});
                             current_line_had_high_confidence_text = true;
                             previous_word_on_line_was_high_confidence = true;
                         } else {
@@ -374,58 +826,455 @@ void ocr_parser::parse(const data_source& data, const std::vector<language>& lan
 
                     // Regardless of word content, if the iterator is at the last word
                     // of the current structural RIL_TEXTLINE, break this word loop.
-                    if (rit->IsAtFinalElement(tesseract::RIL_TEXTLINE, tesseract::RIL_WORD)) {
+                    if (rit.IsAtFinalElement(tesseract::RIL_TEXTLINE, tesseract::RIL_WORD)) {
                         break;
                     }
-                } while (rit->Next(tesseract::RIL_WORD)); // Attempt to advance to the next word
+                } while (rit.Next(tesseract::RIL_WORD)); // Attempt to advance to the next word
 
                 // End of TextLine processing
                 if (current_line_had_high_confidence_text) {
                     // Add BreakLine if not the last line of the current paragraph
-                    if (!rit->IsAtFinalElement(tesseract::RIL_PARA, tesseract::RIL_TEXTLINE)) {
-                        // TODO: Add styling attributes from rit->BoundingBox(RIL_TEXTLINE, ...) to BreakLine if needed
-                        impl().emit_message(document::break_line{});
+                    if (!rit.IsAtFinalElement(tesseract::RIL_PARA, tesseract::RIL_TEXTLINE)) {
+                        // TODO: Add styling attributes from rit.BoundingBox(RIL_TEXTLINE, ...) to BreakLine if needed
+                        result.push_back({recognized_element::kind::break_line});
                     }
                 }
                 // Check if this was the last line in the current paragraph before trying to advance to the next line.
-                if (rit->IsAtFinalElement(tesseract::RIL_PARA, tesseract::RIL_TEXTLINE)) {
+                if (rit.IsAtFinalElement(tesseract::RIL_PARA, tesseract::RIL_TEXTLINE)) {
                     break; // Break from RIL_TEXTLINE loop; Next(RIL_PARA) will be called.
                 }
-            } while (rit->Next(tesseract::RIL_TEXTLINE)); // Advances to next line in this paragraph
+            } while (rit.Next(tesseract::RIL_TEXTLINE)); // Advances to next line in this paragraph
 
             // End of Paragraph processing
-            impl().emit_message(document::close_paragraph{});
+            result.push_back({recognized_element::kind::close_paragraph});
             // Check if this was the last paragraph in the current block before trying to advance to the next paragraph.
-            if (rit->IsAtFinalElement(tesseract::RIL_BLOCK, tesseract::RIL_PARA)) {
+            if (rit.IsAtFinalElement(tesseract::RIL_BLOCK, tesseract::RIL_PARA)) {
                 break; // Break from RIL_PARA loop; Next(RIL_BLOCK) will be called.
             }
-        } while (rit->Next(tesseract::RIL_PARA)); // Advances to next paragraph in this block
+        } while (rit.Next(tesseract::RIL_PARA)); // Advances to next paragraph in this block
 
         // End of Block processing
-        impl().emit_message(document::close_section{});
-    } while (rit->Next(tesseract::RIL_BLOCK)); // Advances to next block on the page
+        result.push_back({recognized_element::kind::close_section});
+    } while (rit.Next(tesseract::RIL_BLOCK)); // Advances to next block on the page
+}
+
+struct block_rectangle
+{
+    int left;
+    int top;
+    int width;
+    int height;
+};
+
+// Returns bounding boxes of the blocks found by layout analysis, in reading order.
+std::vector<block_rectangle> analyse_layout(TessBaseAPI& api)
+{
+    log_scope();
+    std::vector<block_rectangle> blocks;
+    std::unique_ptr<tesseract::PageIterator> it{api.AnalyseLayout()};
+    if (!it)
+        return blocks;
+    it->Begin();
+    do
+    {
+        int left, top, right, bottom;
+        if (it->BoundingBox(tesseract::RIL_BLOCK, &left, &top, &right, &bottom))
+            blocks.push_back({left, top, right - left, bottom - top});
+    } while (it->Next(tesseract::RIL_BLOCK));
+    return blocks;
+}
+
+// Cancellation of recognition of blocks. Only the calling thread reports progress downstream, because
+// message callbacks are not thread safe. Other threads follow its decision.
+struct block_recognition_cancel
+{
+    const message_callbacks* emit_message;
+    std::atomic<bool>& cancelled;
+
+    static bool cancel(void* data, int words)
+    {
+        auto self = reinterpret_cast<block_recognition_cancel*>(data);
+        if (self->emit_message && !self->cancelled && (*self->emit_message)(ocr::please_wait{}) == continuation::stop)
+            self->cancelled = true;
+        return self->cancelled;
+    }
+};
+
+// Recognizes layout blocks of a single image on separate engines, at most concurrency blocks at a time,
+// and merges their results in reading order. The calling thread uses its own engine, with the image already set.
+// Returns false if recognition of any block timed out or was cancelled.
+bool recognize_blocks(TessBaseAPI& api, PIX* image, const std::vector<block_rectangle>& blocks, const tesseract_engine_key& engine_key,
+    float confidence_threshold, std::optional<int32_t> timeout, unsigned int concurrency, const message_callbacks& emit_message,
+    recognition_result& result)
+{
+    log_scope(blocks.size(), concurrency);
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (timeout)
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{*timeout};
+    std::vector<recognition_result> block_results(blocks.size());
+    std::atomic<size_t> next_block = 0;
+    std::atomic<bool> complete = true;
+    std::atomic<bool> cancelled = false;
+    auto recognize_next_blocks = [&](TessBaseAPI& engine, const message_callbacks* progress_emit_message)
+    {
+        block_recognition_cancel cancel_context{progress_emit_message, cancelled};
+        for (size_t i = next_block++; i < blocks.size() && !cancelled; i = next_block++)
+        {
+            engine.SetRectangle(blocks[i].left, blocks[i].top, blocks[i].width, blocks[i].height);
+            tesseract::ETEXT_DESC monitor;
+            if (deadline)
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+                monitor.set_deadline_msecs(std::max<int32_t>(0, static_cast<int32_t>(remaining.count())));
+            }
+            monitor.cancel = &block_recognition_cancel::cancel;
+            monitor.cancel_this = reinterpret_cast<void*>(&cancel_context);
+            if (engine.Recognize(&monitor) != 0 || monitor.deadline_exceeded())
+                complete = false;
+            std::unique_ptr<tesseract::ResultIterator> rit(engine.GetIterator());
+            if (rit)
+                collect_recognized(*rit, confidence_threshold, block_results[i]);
+        }
+    };
+    auto worker = [&]()
+    {
+        // Leptonica reference counting is not thread safe, so every other engine gets its own copy of the image.
+        pix_unique_ptr worker_image{ pixCopy(nullptr, image) };
+        throw_if(!worker_image, "pixCopy failed");
+        tesseract_engine_pool::lease worker_api = tesseract_engine_pool::instance().acquire(engine_key);
+        worker_api->SetImage(worker_image.get());
+        recognize_next_blocks(*worker_api, nullptr);
+    };
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < std::min<size_t>(concurrency, blocks.size()); ++i)
+        workers.push_back(std::async(std::launch::async, worker));
+    recognize_next_blocks(api, &emit_message);
+    for (std::future<void>& worker_future : workers)
+        worker_future.get();
+    for (recognition_result& block_result : block_results)
+        std::move(block_result.begin(), block_result.end(), std::back_inserter(result));
+    return complete && !cancelled;
+}
+
+} // anonymous namespace
+
+ocr_parser::ocr_parser(const std::vector<language>& languages,
+                     ocr_confidence_threshold ocr_confidence_threshold_arg,
+                     ocr_timeout ocr_timeout_arg,
+                     ocr_data_path ocr_data_path_arg,
+                     ocr_concurrency ocr_concurrency_arg,
+                     ocr_prefilter ocr_prefilter_arg,
+                     ocr_downscaling ocr_downscaling_arg,
+                     ocr_result_cache ocr_result_cache_arg,
+                     ocr_region_parallelism ocr_region_parallelism_arg)
+{
+    log_scope(languages, ocr_confidence_threshold_arg, ocr_timeout_arg, ocr_data_path_arg, ocr_concurrency_arg);
+    impl().m_languages = languages;
+    impl().m_ocr_confidence_threshold = ocr_confidence_threshold_arg;
+    impl().m_ocr_timeout = ocr_timeout_arg;
+    impl().m_ocr_data_path = ocr_data_path_arg.v.empty() ? default_tessdata_path() : ocr_data_path_arg;
+    impl().m_ocr_concurrency = ocr_concurrency_arg;
+    impl().m_ocr_prefilter = ocr_prefilter_arg;
+    impl().m_ocr_downscaling = ocr_downscaling_arg;
+    impl().m_ocr_result_cache = ocr_result_cache_arg;
+    impl().m_ocr_region_parallelism = ocr_region_parallelism_arg;
+    if (ocr_concurrency_arg.v > 1)
+    {
+        impl().m_max_in_flight_images = static_cast<std::ptrdiff_t>(ocr_concurrency_arg.v);
+        impl().m_in_flight_images = std::make_unique<std::counting_semaphore<>>(impl().m_max_in_flight_images);
+    }
+}
+
+void ocr_parser::parse(Pix* image, const std::vector<language>& languages, const message_callbacks& emit_message)
+{
+    log_scope(languages);
+
+    std::string langs = std::accumulate(languages.begin(), languages.end(), std::string{},
+      [](const std::string& acc, const language& lang)
+      {
+        return acc + (acc.empty() ? "" : "+") + boost::lexical_cast<std::string>(lang);
+      });
+    log_entry(langs);
+
+    // Convert to a gray-scale image
+    pix_unique_ptr gray{ nullptr };
+
+    pix_unique_ptr inverted{ nullptr };
+    shade_histogram shades{}; // of the image passed to recognition
+    try
+    {
+        gray.reset(pixToGrayscale(image));
+        if (pix_unique_ptr scaled = downscale(gray.get(), impl().m_ocr_downscaling))
+        {
+            gray = std::move(scaled);
+        }
+        std::unique_ptr<NUMA, decltype([](NUMA* numa) { numaDestroy(&numa); })> histogram{ pixGetGrayHistogram(gray.get(), 1) };
+
+        double weight_sum{ 0 };
+        double sum{ 0 };
+
+        constexpr int shadeScale{ 256 }; // where 0 - black, 255 - white
+        for(int i{ 0 }; i < shadeScale; ++i)
+        {
+            // calculating weighted average of shade
+            sum += (i+1) * histogram->array[i];
+            weight_sum += histogram->array[i];
+        }
+
+        bool invert = static_cast<int>(sum / weight_sum) <= shadeScale / 2;
+        for(int i{ 0 }; i < shadeScale; ++i)
+        {
+            shades[invert ? shadeScale - 1 - i : i] = histogram->array[i];
+        }
+        if(invert)
+        {
+            inverted.reset(pixInvert(nullptr, gray.get()));
+        }
+        else
+        {
+            inverted.reset(gray.release());
+        }
+    }
+    catch(const std::exception& e)
+    {
+        throw;
+    }
+
+    if (impl().m_ocr_prefilter.enabled)
+    {
+        switch (prefilter(inverted.get(), shades, impl().m_ocr_prefilter))
+        {
+            case prefilter_verdict::recognize:
+                break;
+            case prefilter_verdict::too_small:
+                ++impl().m_skipped_too_small_images;
+                return;
+            case prefilter_verdict::blank:
+                ++impl().m_skipped_blank_images;
+                return;
+            case prefilter_verdict::without_components:
+                ++impl().m_skipped_images_without_components;
+                return;
+        }
+    }
+    ++impl().m_recognized_images;
+
+    const float confidence_threshold = impl().m_ocr_confidence_threshold.v.value_or(75.0f);
+    const ocr_region_parallelism& region_parallelism = impl().m_ocr_region_parallelism;
+    // Blocks recognized separately can give different results than the whole image, so the mode is a part of the cache key.
+    const bool region_mode = region_parallelism.concurrency > 1 &&
+        static_cast<size_t>(pixGetWidth(inverted.get())) * pixGetHeight(inverted.get()) >= region_parallelism.min_pixels;
+    std::string cache_key;
+    if (impl().m_ocr_result_cache.enabled)
+    {
+        recognition_key_hasher hasher;
+        hasher.add_pixels(inverted.get());
+        hasher.add(langs);
+        hasher.add(std::bit_cast<uint32_t>(confidence_threshold));
+        hasher.add(impl().m_ocr_data_path.v.string());
+        hasher.add(static_cast<uint64_t>(tesseract::OEM_DEFAULT));
+        hasher.add(static_cast<uint64_t>(region_mode));
+        cache_key = hasher.hex_digest();
+        if (std::shared_ptr<const recognition_result> cached =
+            recognition_result_cache::instance().find(cache_key, impl().m_ocr_result_cache))
+        {
+            log_entry(cache_key);
+            emit_recognized(*cached, emit_message);
+            return;
+        }
+    }
+
+    tesseract_engine_key engine_key{impl().m_ocr_data_path.v.string(), langs, tesseract::OEM_DEFAULT};
+    tesseract_engine_pool::lease api = tesseract_engine_pool::instance().acquire(engine_key);
+    api->SetImage(inverted.get());
+    tesseract::ETEXT_DESC monitor;
+    if (impl().m_ocr_timeout.v)
+    {
+        monitor.set_deadline_msecs(*impl().m_ocr_timeout.v);
+    }
+    monitor.cancel = &pimpl_impl<ocr_parser>::cancel;
+    context cancel_context{emit_message};
+    monitor.cancel_this = reinterpret_cast<void*>(&cancel_context);
+
+    auto result = std::make_shared<recognition_result>();
+    bool recognition_complete;
+    std::vector<block_rectangle> blocks;
+    if (region_mode)
+    {
+        blocks = analyse_layout(*api);
+        log_entry(blocks.size());
+    }
+    if (blocks.size() > 1)
+    {
+        recognition_complete = recognize_blocks(*api, inverted.get(), blocks, engine_key, confidence_threshold,
+            impl().m_ocr_timeout.v, region_parallelism.concurrency, emit_message, *result);
+    }
+    else
+    {
+        // Recognize the image
+        recognition_complete = api->Recognize(&monitor) == 0 && !monitor.deadline_exceeded() && !cancel_context.cancelled;
+
+        std::unique_ptr<tesseract::ResultIterator> rit(api->GetIterator());
+        if (!rit) {
+            log_entry();
+            return;
+        }
+        collect_recognized(*rit, confidence_threshold, *result);
+    }
+
+    // Results of cancelled or timed out recognition are partial, so they are not cached.
+    if (!cache_key.empty() && recognition_complete)
+        recognition_result_cache::instance().put(cache_key, result, impl().m_ocr_result_cache);
+    emit_recognized(*result, emit_message);
+}
+
+void ocr_parser::parse_pages(const data_source& data, const std::vector<language>& languages, const message_callbacks& emit_message)
+{
+    log_scope(data, languages);
+    std::span<const std::byte> tiff_data = data.span();
+    size_t offset = 0;
+    // Pages are decoded one at a time, so only the compressed file and the pages being recognized are in memory.
+    auto read_next_page = [&]()
+    {
+        std::lock_guard<std::mutex> lock { tesseract_libtiff_mutex };
+        leptonica_stderr_capturer leptonica_stderr_capturer;
+        PIX* pix = pixReadMemFromMultipageTiff(reinterpret_cast<const l_uint8*>(tiff_data.data()), tiff_data.size(), &offset);
+        throw_if(!pix, "Could not load image", errors::uninterpretable_data{}, leptonica_stderr_capturer.contents());
+        return std::shared_ptr<PIX>{pix, [](PIX* pix) { pixDestroy(&pix); }};
+    };
+    std::shared_ptr<PIX> page = read_next_page();
+    if (offset == 0)
+    {
+        log_entry();
+        parse(page.get(), languages, emit_message);
+        return;
+    }
+
+    // Emits a recognized page with page framing. Returns false if processing should stop.
+    auto emit_page = [&emit_message](const std::function<void(const message_callbacks&)>& emit_content)
+    {
+        continuation response = emit_message(document::page{});
+        if (response == continuation::stop)
+            return false;
+        if (response != continuation::skip)
+            emit_content(emit_message);
+        return emit_message(document::close_page{}) != continuation::stop;
+    };
+
+    if (impl().m_ocr_concurrency.v <= 1)
+    {
+        while (page)
+        {
+            if (!emit_page([&](const message_callbacks& emit_message) { parse(page.get(), languages, emit_message); }))
+                return;
+            page = offset != 0 ? read_next_page() : nullptr;
+        }
+        return;
+    }
+
+    // Pages are recognized in the background and emitted in order, with a bounded number of pages in flight.
+    // Declared before the pages, so that it outlives their recognition.
+    std::atomic<bool> cancelled = false;
+    std::deque<std::future<std::vector<message_ptr>>> in_flight_pages;
+    auto emit_oldest_page = [&]()
+    {
+        // Waiting is reported like recognition progress, so the consumer can still cancel it.
+        while (in_flight_pages.front().wait_for(std::chrono::milliseconds{100}) != std::future_status::ready)
+            if (!cancelled && emit_message(ocr::please_wait{}) == continuation::stop)
+                cancelled = true;
+        if (cancelled)
+            return false;
+        std::vector<message_ptr> messages = in_flight_pages.front().get();
+        in_flight_pages.pop_front();
+        return emit_page([&messages](const message_callbacks& emit_message)
+        {
+            for (const message_ptr& msg : messages)
+                if (emit_message(msg) == continuation::stop)
+                    break;
+        });
+    };
+    while (page)
+    {
+        in_flight_pages.push_back(std::async(std::launch::async, [this, page, languages, &cancelled]()
+        {
+            std::vector<message_ptr> messages;
+            auto collect = [&messages, &cancelled](message_ptr msg)
+            {
+                if (msg->is<ocr::please_wait>())
+                    return cancelled ? continuation::stop : continuation::proceed;
+                messages.push_back(std::move(msg));
+                return continuation::proceed;
+            };
+            parse(page.get(), languages, message_callbacks{collect, collect});
+            return messages;
+        }));
+        page = nullptr;
+        if (in_flight_pages.size() >= 2 * impl().m_ocr_concurrency.v && !emit_oldest_page())
+            return;
+        if (offset != 0)
+            page = read_next_page();
+    }
+    while (!in_flight_pages.empty())
+        if (!emit_oldest_page())
+            return;
+}
+
+ocr_prefilter_statistics ocr_parser::prefilter_statistics() const
+{
+    return ocr_prefilter_statistics{
+        .recognized = impl().m_recognized_images,
+        .skipped_too_small = impl().m_skipped_too_small_images,
+        .skipped_blank = impl().m_skipped_blank_images,
+        .skipped_without_components = impl().m_skipped_images_without_components
+    };
 }
 
 continuation ocr_parser::operator()(message_ptr msg, const message_callbacks& emit_message)
 {
     log_scope(msg);
 
-    auto process = [this](const data_source& data, const message_callbacks& emit_message) {
+    auto process = [this](const data_source& data, const std::optional<raster_image_provider>& raster, const message_callbacks& emit_message) {
         log_scope(data);
-        scoped::stack_push<context> context_guard{impl().m_context_stack, context{emit_message}};
         emit_message(document::document{.metadata = []() { return attributes::metadata{}; }});
-        parse(data, impl().m_languages.size() > 0 ? impl().m_languages : std::vector({ language::eng }));
+        std::vector<language> languages = impl().m_languages.size() > 0 ? impl().m_languages : std::vector({ language::eng });
+        if (raster)
+        {
+            // Decoded pixels passed by the producer (e.g. PDF parser) are used directly, without decoding the source.
+            parse(pix_from_raster_image((*raster)()).get(), languages, emit_message);
+        }
+        else if (data.has_highest_confidence_mime_type_in({mime_type{"image/tiff"}}))
+            parse_pages(data, languages, emit_message);
+        else
+            parse(load_pix(data).get(), languages, emit_message);
         emit_message(document::close_document{});
         return continuation::proceed;
     };
 
+    // Held messages are emitted later, so responses to them cannot skip anything. Only leaf messages are held,
+    // and any other message emits the held ones first.
+    if (!impl().m_held_messages.empty() &&
+        !msg->is<document::text>() && !msg->is<document::break_line>() && !msg->is<document::image>() &&
+        impl().emit_held_messages(emit_message, true) == continuation::stop)
+        return continuation::stop;
+    if (msg->is<document::document>())
+        ++impl().m_open_documents;
+    else if (msg->is<document::close_document>() && impl().m_open_documents > 0)
+        --impl().m_open_documents;
+    auto forward = [this, &emit_message](message_ptr msg)
+    {
+        if (impl().m_held_messages.empty())
+            return emit_message(std::move(msg));
+        impl().m_held_messages.push_back(std::move(msg));
+        return continuation::proceed;
+    };
+
     if (msg->is<data_source>())
     {
         log_scope();
         const data_source& data = msg->get<data_source>();
         data.assert_not_encrypted();
         if (data.has_highest_confidence_mime_type_in(supported_mime_types))
-            return process(msg->get<data_source>(), emit_message);
+            return process(msg->get<data_source>(), std::nullopt, emit_message);
         else
             return emit_message(std::move(msg));
     }
@@ -434,22 +1283,87 @@ continuation ocr_parser::operator()(message_ptr msg, const message_callbacks& em
         log_scope();
         document::image& image = msg->get<document::image>();
         image.source.assert_not_encrypted();
-        if (!image.source.highest_confidence_mime_type().has_value())
+        if (!image.raster)
         {
-            log_entry();
-            return emit_message(std::move(msg));
+            if (!image.source.highest_confidence_mime_type().has_value())
+            {
+                log_entry();
+                return forward(std::move(msg));
+            }
+            if (!image.source.has_highest_confidence_mime_type_in(supported_mime_types))
+            {
+                log_entry();
+                return forward(std::move(msg));
+            }
         }
-        if (!image.source.has_highest_confidence_mime_type_in(supported_mime_types))
+        if (impl().m_in_flight_images)
         {
-            log_entry();
-            return emit_message(std::move(msg));
+            // Recognition starts in the background right away and the streamer replays its result. The image and
+            // the text following it are held back until the limit of images in flight is reached, because
+            // consumers read images as they come and would otherwise wait for each recognition in turn.
+            while (!impl().m_in_flight_images->try_acquire())
+            {
+                if (impl().m_held_messages.empty())
+                {
+                    impl().m_in_flight_images->acquire();
+                    break;
+                }
+                if (impl().emit_held_messages(emit_message, false) == continuation::stop)
+                    return continuation::stop;
+            }
+            auto recognition = std::make_shared<deferred_recognition>();
+            recognition->recognized = std::async(std::launch::async,
+                [this, process, data = image.source, raster = image.raster, cancelled = recognition->cancelled]()
+                {
+                    struct in_flight_release
+                    {
+                        std::counting_semaphore<>& in_flight_images;
+                        ~in_flight_release() { in_flight_images.release(); }
+                    } in_flight_release_guard{*impl().m_in_flight_images};
+                    std::vector<message_ptr> messages;
+                    auto collect = [&messages, &cancelled](message_ptr msg)
+                    {
+                        // Cancelled by the streamer that waits for the result, or because the image was dropped.
+                        if (msg->is<ocr::please_wait>())
+                            return *cancelled ? continuation::stop : continuation::proceed;
+                        messages.push_back(std::move(msg));
+                        return continuation::proceed;
+                    };
+                    process(data, raster, message_callbacks{collect, collect});
+                    return messages;
+                }).share();
+            image.structured_content_streamer =
+                [recognition](const message_callbacks& emit_message) -> continuation
+                {
+                    try
+                    {
+                        // Waiting is reported like recognition progress, so the consumer can still cancel it.
+                        while (recognition->recognized.wait_for(std::chrono::milliseconds{100}) != std::future_status::ready)
+                            if (!*recognition->cancelled && emit_message(ocr::please_wait{}) == continuation::stop)
+                                *recognition->cancelled = true;
+                        for (const message_ptr& msg : recognition->recognized.get())
+                            if (emit_message(msg) == continuation::stop)
+                                return continuation::stop;
+                        return continuation::proceed;
+                    }
+                    catch (const std::exception&)
+                    {
+                        emit_message(make_nested_ptr(std::current_exception(), make_error("OCR processing of image failed")));
+                        return continuation::proceed;
+                    }
+                };
+            // Outside of a document nothing would emit the held messages.
+            if (impl().m_open_documents == 0)
+                return emit_message(std::move(msg));
+            impl().m_held_messages.push_back(std::move(msg));
+            return continuation::proceed;
         }
         image.structured_content_streamer =
-            [process, data = image.source](const message_callbacks& emit_message) -> continuation
+            [process, data = image.source, raster = image.raster](const message_callbacks& emit_message) -> continuation
             {
                 try
                 {
-                    return process(data, emit_message);
+                    return process(data, raster, emit_message);
                 }
                 catch (const std::exception&)
                 {
@@ -460,7 +1374,7 @@ continuation ocr_parser::operator()(message_ptr msg, const message_callbacks& em
         return emit_message(std::move(msg));
     }
     else
-        return emit_message(std::move(msg));
+        return forward(std::move(msg));
 }
 
 } // namespace docwire
@@ -20,8 +20,11 @@
 #include "ocr_export.h"
 #include <optional>
 #include "pimpl.h"
+#include "raster_image.h"
 #include <vector>
 
+struct Pix;
+
 namespace docwire
 {
 
@@ -35,6 +38,53 @@ struct please_wait {};
 struct ocr_confidence_threshold { std::optional<float> v; };
 struct ocr_data_path { std::filesystem::path v; };
 struct ocr_timeout { std::optional<int32_t> v; };
+/// Number of images recognized in parallel. Recognition of an image starts in the background when it passes through the
+/// parser, and the image is held back with the text following it until that many images are in flight or the document
+/// closes. Results are still emitted in the order of images.
+struct ocr_concurrency { unsigned int v; };
+
+/// Thresholds of the cheap checks that skip recognition of images that cannot contain text.
+struct ocr_prefilter
+{
+    bool enabled = false; ///< Off by default, because it also drops images with very little text (e.g. a single glyph).
+    int min_width = 10; ///< Narrower images (icons, separator lines) are skipped.
+    int min_height = 10; ///< Lower images are skipped.
+    float min_gray_variance = 4.0f; ///< Images with less contrast (blank pages, solid backgrounds) are skipped.
+    float min_ink_ratio = 0.0001f; ///< Minimum fraction of pixels darker than the Otsu threshold.
+    int min_components = 2; ///< Minimum number of connected ink components (a single line or blot is not text).
+};
+
+/// Limits of the resolution images are downscaled to before recognition. Images are never upscaled.
+/// No limit is set by default. 300 DPI and 25 megapixels speed up high-resolution scans without losing accuracy.
+struct ocr_downscaling
+{
+    std::optional<int> target_dpi; ///< Accuracy does not improve above 300, but recognition time does grow.
+    std::optional<size_t> max_pixels; ///< Limits images without reliable resolution, like photos.
+};
+
+/// Cache of recognition results keyed by a hash of the image pixels and recognition parameters.
+struct ocr_result_cache
+{
+    bool enabled = false; ///< Results are kept in memory of the process. Repeated images are then not recognized again.
+    std::optional<std::filesystem::path> directory; ///< If set, results are also kept there and shared between runs.
+    bool in_memory = true; ///< If false, results are kept only in the directory, e.g. when it is shared by many processes.
+};
+
+/// Recognition of layout blocks of a single large image in parallel, on separate engines.
+struct ocr_region_parallelism
+{
+    unsigned int concurrency = 1; ///< Number of blocks recognized at once. 1 disables layout-based splitting.
+    size_t min_pixels = 8'000'000; ///< Smaller images are recognized as a whole.
+};
+
+/// Numbers of images recognized and skipped by ocr_prefilter since the parser was created.
+struct ocr_prefilter_statistics
+{
+    size_t recognized = 0;
+    size_t skipped_too_small = 0;
+    size_t skipped_blank = 0;
+    size_t skipped_without_components = 0;
+};
 
 class DOCWIRE_OCR_EXPORT ocr_parser : public chain_element, public with_pimpl<ocr_parser>
 {
@@ -47,14 +97,22 @@ public:
     ocr_parser(const std::vector<language>& languages = {},
         ocr_confidence_threshold ocr_confidence_threshold_arg = {},
         ocr_timeout ocr_timeout_arg = {},
-        ocr_data_path ocr_data_path_arg = {});
+        ocr_data_path ocr_data_path_arg = {},
+        ocr_concurrency ocr_concurrency_arg = ocr_concurrency{1},
+        ocr_prefilter ocr_prefilter_arg = {},
+        ocr_downscaling ocr_downscaling_arg = {},
+        ocr_result_cache ocr_result_cache_arg = {},
+        ocr_region_parallelism ocr_region_parallelism_arg = {});
 
     continuation operator()(message_ptr msg, const message_callbacks& emit_message) override;
 
     bool is_leaf() const override { return false; }
 
+    ocr_prefilter_statistics prefilter_statistics() const;
+
 private:
-    void parse(const data_source& data, const std::vector<language>& languages);
+    void parse(Pix* image, const std::vector<language>& languages, const message_callbacks& emit_message);
+    void parse_pages(const data_source& data, const std::vector<language>& languages, const message_callbacks& emit_message);
 };
 
 } // namespace docwire
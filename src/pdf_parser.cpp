@@ -13,17 +13,29 @@
 
 #include <cmath>
 #include "convert_chrono.h" // IWYU pragma: keep
+#include "binary_reader.h"
 #include "data_source.h"
+#include "diagnostic_message.h"
 #include "document_elements.h"
 #include "error_tags.h"
 #include "log_entry.h"
 #include "log_scope.h"
 #include "make_error.h"
-#include <leptonica/allheaders.h>
+#include "leptonica_raster_image.h"
 #include <mutex>
 #include "nested_exception.h"
 #ifdef _WIN32
 	#define NOMINMAX
+#else
+	#include <atomic>
+	#include <condition_variable>
+	#include <csignal>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/wait.h>
+	#include <thread>
+	#include <unistd.h>
 #endif
 #include <pdfium/cpp/fpdf_scopers.h>
 #include <pdfium/fpdf_doc.h>
@@ -49,106 +61,840 @@ namespace
 {
 	std::mutex pdfium_mutex;
 
-using pix_unique_ptr = std::unique_ptr<PIX, decltype([](PIX* pix) { pixDestroy(&pix); })>;
 using leptonica_data_ptr = std::unique_ptr<l_uint8, decltype(&lept_free)>;
 
-pix_unique_ptr create_pix_from_fpdf_bitmap(int width, int height, int stride, int format, const unsigned char* pixels, l_int32 horizontal_dpi, l_int32 vertical_dpi)
+pixel_format pixel_format_from_fpdf_bitmap_format(int format)
 {
-	log_scope(width, height, stride, format, horizontal_dpi, vertical_dpi);
-	pix_unique_ptr pix;
-
-	if (format == FPDFBitmap_Gray)
+	switch (format)
 	{
-		pix = pix_unique_ptr{pixCreate(width, height, 8)};
-		throw_if(!pix, "pixCreate failed for grayscale");
-		pixSetXRes(pix.get(), horizontal_dpi);
-		pixSetYRes(pix.get(), vertical_dpi);
+		case FPDFBitmap_Gray: return pixel_format::gray8;
+		case FPDFBitmap_BGR: return pixel_format::bgr24;
+		case FPDFBitmap_BGRx: return pixel_format::bgrx32;
+		case FPDFBitmap_BGRA: return pixel_format::bgra32;
+		default:
+			throw make_error("Unsupported FPDFBitmap format", format, errors::uninterpretable_data{});
+	}
+}
 
-		l_uint32 wpl = pixGetWpl(pix.get());
-		l_uint32* pix_data = pixGetData(pix.get());
-		for (int y = 0; y < height; ++y)
+using shared_fpdf_document = std::shared_ptr<std::remove_pointer_t<FPDF_DOCUMENT>>;
+
+using shared_fpdf_page = std::shared_ptr<std::remove_pointer_t<FPDF_PAGE>>;
+
+// Page loaded on first use and shared by the image objects on it that wait to be decoded, so it is loaded only once.
+// Used with pdfium_mutex locked. The page keeps its document open and is closed under pdfium_mutex
+// by whichever thread releases it last, so the last reference must not be dropped with the lock held.
+struct lazy_fpdf_page
+{
+	shared_fpdf_document document;
+	int page_num;
+	shared_fpdf_page page;
+
+	FPDF_PAGE get()
+	{
+		if (!page)
 		{
-			l_uint32* line = pix_data + y * wpl;
-			const unsigned char* src_line = pixels + y * stride;
-			for (int x = 0; x < width; ++x)
-				SET_DATA_BYTE(line, x, src_line[x]);
+			page = shared_fpdf_page
+			{
+				FPDF_LoadPage(document.get(), page_num),
+				[document = document](FPDF_PAGE page)
+				{
+					if (!page)
+						return;
+					std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+					FPDF_ClosePage(page);
+				}
+			};
+			throw_if(!page, "FPDF_LoadPage failed", page_num);
 		}
+		return page.get();
+	}
+};
+
+// Decodes the image object with PDFium on first use of its raster.
+raster_image decode_image_object(lazy_fpdf_page& lazy_page, int object_index)
+{
+	log_scope(lazy_page.page_num, object_index);
+	std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+	FPDF_PAGE page = lazy_page.get();
+	FPDF_PAGEOBJECT object = FPDFPage_GetObject(page, object_index);
+	throw_if(!object, "FPDFPage_GetObject failed", object_index);
+	ScopedFPDFBitmap bitmap { FPDFImageObj_GetBitmap(object) };
+	throw_if(!bitmap, "FPDFImageObj_GetBitmap failed");
+	int width = FPDFBitmap_GetWidth(bitmap.get());
+	int height = FPDFBitmap_GetHeight(bitmap.get());
+	int stride = FPDFBitmap_GetStride(bitmap.get());
+	const std::byte* pixels = static_cast<const std::byte*>(FPDFBitmap_GetBuffer(bitmap.get()));
+	pixel_format format = pixel_format_from_fpdf_bitmap_format(FPDFBitmap_GetFormat(bitmap.get()));
+
+	FPDF_IMAGEOBJ_METADATA image_metadata;
+	int h_res = 72; // Default DPI
+	int v_res = 72;   // Default DPI
+	if (FPDFImageObj_GetImageMetadata(object, page, &image_metadata)) {
+		if (image_metadata.horizontal_dpi > 0.0f)
+			h_res = static_cast<int>(image_metadata.horizontal_dpi);
+		if (image_metadata.vertical_dpi > 0.0f)
+			v_res = static_cast<int>(image_metadata.vertical_dpi);
 	}
-	else if (format == FPDFBitmap_BGR || format == FPDFBitmap_BGRx)
+	return raster_image{
+		.pixels = std::make_shared<const std::vector<std::byte>>(pixels, pixels + static_cast<size_t>(stride) * height),
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.format = format,
+		.horizontal_dpi = h_res,
+		.vertical_dpi = v_res
+	};
+}
+
+// Returns a provider that decodes the image object on first use and then returns the cached pixels.
+// The provider keeps the page open until the image is decoded and releases it afterwards.
+raster_image_provider lazy_image_object_raster(std::shared_ptr<lazy_fpdf_page> page, int object_index)
+{
+	struct decoded_raster
 	{
-		pix = pix_unique_ptr{pixCreate(width, height, 32)};
-		throw_if (!pix, "pixCreate failed for BGR/BGRx");
-		pixSetXRes(pix.get(), horizontal_dpi);
-		pixSetYRes(pix.get(), vertical_dpi);
+		std::once_flag once;
+		std::shared_ptr<lazy_fpdf_page> page;
+		std::optional<raster_image> raster;
+	};
+	auto decoded = std::make_shared<decoded_raster>();
+	decoded->page = std::move(page);
+	return [decoded, object_index]()
+	{
+		std::call_once(decoded->once, [&]()
+		{
+			decoded->raster = decode_image_object(*decoded->page, object_index);
+			decoded->page.reset();
+		});
+		return *decoded->raster;
+	};
+}
+
+// The PNG is encoded only if a consumer reads the image data. OCR uses the raster directly.
+data_source png_data_source(raster_image_provider raster)
+{
+	return data_source{
+		memory_buffer_producer{[raster]()
+		{
+			log_scope();
+			pix_unique_ptr pix = pix_from_raster_image(raster());
+			l_uint8* png_data_raw = nullptr;
+			size_t png_size = 0;
+			throw_if (pixWriteMemPng(&png_data_raw, &png_size, pix.get(), 0.0f) != 0);
+			throw_if (!png_data_raw);
+			leptonica_data_ptr png_data(png_data_raw, lept_free);
+			throw_if (png_size <= 0);
+			auto buffer = std::make_shared<memory_buffer>(png_size);
+			memcpy(buffer->data(), png_data.get(), png_size);
+			return buffer;
+		}},
+		mime_type { "image/png" }, confidence::highest};
+}
+
+attributes::position position_from_bounds(float left, float bottom, float right, float top)
+{
+	return attributes::position{
+		.x = std::optional<double>{static_cast<double>(left)},
+		.y = std::optional<double>{static_cast<double>(bottom)},
+		.width = std::optional<double>{static_cast<double>(right - left)},
+		.height = std::optional<double>{static_cast<double>(top - bottom)}
+	};
+}
+
+// Image object whose pixels are decoded later, by the process that emits the image.
+struct image_object
+{
+	int index;
+	attributes::position position;
+};
+
+using page_object = std::variant<document::text, image_object, std::exception_ptr>;
 
-		int bytes_per_pixel = (format == FPDFBitmap_BGRx) ? 4 : 3;
-		l_uint32 wpl = pixGetWpl(pix.get());
-		l_uint32* pix_data = pixGetData(pix.get());
-		for (int y = 0; y < height; ++y)
+// Reads all text objects and image bounds of the page. Must be called with pdfium_mutex locked.
+std::vector<page_object> read_page_objects(FPDF_PAGE page)
+{
+	log_scope();
+	// text_page is only needed for FPDFTextObj_GetText, so load it if/when a text object is found.
+	ScopedFPDFTextPage text_page { nullptr };
+
+	int object_count = FPDFPage_CountObjects(page);
+	throw_if (object_count < 0, "FPDFPage_CountObjects returned negative count");
+	thread_local charset_converter conv("UTF-16LE", "UTF-8");
+	std::vector<page_object> objects;
+	objects.reserve(object_count);
+	for (int i = 0; i < object_count; ++i)
+	{
+		try
 		{
-			const unsigned char* src_line = pixels + y * stride;
-			l_uint32* line = pix_data + y * wpl;
-			for (int x = 0; x < width; ++x)
+			FPDF_PAGEOBJECT object = FPDFPage_GetObject(page, i);
+			throw_if (!object);
+			int object_type = FPDFPageObj_GetType(object);
+			switch (object_type)
 			{
-				l_uint8 b = src_line[x * bytes_per_pixel + 0];
-				l_uint8 g = src_line[x * bytes_per_pixel + 1];
-				l_uint8 r = src_line[x * bytes_per_pixel + 2];
-				l_uint32 rgba_pixel = 0;
-				throw_if(
-					composeRGBAPixel(r, g, b, 255, &rgba_pixel) != 0,
-					"composeRGBAPixel failed for BGR/BGRx pixel",
-					x, y
-				);
-				line[x] = rgba_pixel;
+				case FPDF_PAGEOBJ_TEXT:
+				{
+					if (!text_page) { // Load text_page on demand
+						text_page.reset(FPDFText_LoadPage(page));
+						throw_if(!text_page, "FPDFText_LoadPage failed");
+					}
+					unsigned long buffer_size = FPDFTextObj_GetText(object, text_page.get(), nullptr, 0);
+					std::string utf8_text;
+					if (buffer_size > 0) { // FPDFTextObj_GetText needs at least 2 bytes for empty string (null terminator)
+						std::vector<unsigned short> buffer(buffer_size / sizeof(unsigned short)); // buffer_size is in bytes
+						unsigned long bytes_returned = FPDFTextObj_GetText(object, text_page.get(), buffer.data(), buffer_size);
+						throw_if(bytes_returned > buffer_size || (bytes_returned == 0 && buffer_size >0) , "FPDFTextObj_GetText failed to retrieve text or returned unexpected size");
+						if (bytes_returned > 0) { // bytes_returned includes the null terminator(s)
+							utf8_text = conv.convert(std::string_view{
+								reinterpret_cast<const char*>(buffer.data()),
+								bytes_returned - sizeof(unsigned short) // Exclude UTF-16LE NULL terminator
+							});
+						}
+					}
+
+					float left, bottom, right, top;
+					throw_if(!FPDFPageObj_GetBounds(object, &left, &bottom, &right, &top));
+
+					float font_size_val = 0.0f;
+					FPDF_FONT font = FPDFTextObj_GetFont(object);
+					if (font)
+					{
+						log_scope();
+						if (!FPDFTextObj_GetFontSize(object, &font_size_val) || font_size_val <= 0) {
+							log_entry();
+							font_size_val = 10.0f; // Default if not found
+						}
+					}
+					objects.push_back(document::text{
+						.text = utf8_text,
+						.position = position_from_bounds(left, bottom, right, top),
+						.font_size = static_cast<double>(font_size_val)
+					});
+					break;
+				}
+				case FPDF_PAGEOBJ_IMAGE:
+				{
+					float left, bottom, right, top;
+					throw_if(!FPDFPageObj_GetBounds(object, &left, &bottom, &right, &top));
+					objects.push_back(image_object{.index = i, .position = position_from_bounds(left, bottom, right, top)});
+					break;
+				}
+				default:
+					break;
 			}
 		}
+		catch (const std::exception&)
+		{
+			objects.push_back(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process object", i)));
+		}
+	}
+	return objects;
+}
+
+void init_pdfium_once()
+{
+	class pdfium_lifecycle_manager
+	{
+	public:
+		pdfium_lifecycle_manager()
+		{
+			FPDF_LIBRARY_CONFIG config;
+			config.version = 2;
+			config.m_pUserFontPaths = nullptr;
+			config.m_pIsolate = nullptr;
+			config.m_v8EmbedderSlot = 0;
+			std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+			FPDF_InitLibraryWithConfig(&config);
+		}
+
+		~pdfium_lifecycle_manager()
+		{
+			std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+			FPDF_DestroyLibrary();
+		}
+	};
+	static pdfium_lifecycle_manager pdfium_manager;
+}
+
+#ifndef _WIN32
+
+// Helper processes communicate with the parser over a socket. Integers are sent little-endian.
+enum class helper_request : uint8_t { open_document = 1, read_page = 2, close_document = 3 };
+enum class helper_status : uint8_t { ok = 0, failed = 1 };
+enum class page_object_kind : uint8_t { text = 0, image = 1, error = 2 };
+
+void send_all(int socket, std::span<const std::byte> data)
+{
+#ifdef MSG_NOSIGNAL
+	constexpr int flags = MSG_NOSIGNAL; // A helper that exited must not kill the parser with SIGPIPE
+#else
+	constexpr int flags = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+	while (!data.empty())
+	{
+		ssize_t sent = ::send(socket, data.data(), data.size(), flags);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		throw_if (sent <= 0, "Sending to PDF helper process failed", errno);
+		data = data.subspan(sent);
+	}
+}
+
+void receive_all(int socket, std::span<std::byte> data)
+{
+	while (!data.empty())
+	{
+		ssize_t received = ::recv(socket, data.data(), data.size(), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		throw_if (received <= 0, "Receiving from PDF helper process failed", errno);
+		data = data.subspan(received);
+	}
+}
+
+// Builds a request or response in memory, so it is sent with a single write.
+class protocol_writer
+{
+public:
+	template <std::integral T>
+	void write(T value)
+	{
+		size_t offset = m_bytes.size();
+		m_bytes.resize(offset + sizeof(T));
+		binary::store_little_endian(value, std::span<std::byte>{m_bytes}.subspan(offset));
 	}
-	else if (format == FPDFBitmap_BGRA)
+
+	template <typename T> requires std::is_enum_v<T>
+	void write(T value)
 	{
-		pix = pix_unique_ptr{pixCreate(width, height, 32)};
-		throw_if (!pix, "pixCreate failed for BGRA");
-		pixSetXRes(pix.get(), horizontal_dpi);
-		pixSetYRes(pix.get(), vertical_dpi);
-		pixSetSpp(pix.get(), 4);
+		write(static_cast<std::underlying_type_t<T>>(value));
+	}
 
-		l_uint32 wpl = pixGetWpl(pix.get());
-		l_uint32* pix_data = pixGetData(pix.get());
+	void write(double value)
+	{
+		write(std::bit_cast<uint64_t>(value));
+	}
 
-		for (int y = 0; y < height; ++y)
+	void write(std::string_view value)
+	{
+		write(static_cast<uint64_t>(value.size()));
+		const std::byte* data = reinterpret_cast<const std::byte*>(value.data());
+		m_bytes.insert(m_bytes.end(), data, data + value.size());
+	}
+
+	void send(int socket) const
+	{
+		send_all(socket, m_bytes);
+	}
+
+private:
+	std::vector<std::byte> m_bytes;
+};
+
+class protocol_reader
+{
+public:
+	explicit protocol_reader(int socket)
+		: m_reader{[socket](std::span<std::byte> dest) { receive_all(socket, dest); }}
+	{}
+
+	template <typename T> requires std::is_integral_v<T> || std::is_enum_v<T>
+	T read()
+	{
+		if constexpr (std::is_enum_v<T>)
+			return static_cast<T>(m_reader.read_little_endian<std::underlying_type_t<T>>());
+		else
+			return m_reader.read_little_endian<T>();
+	}
+
+	double read_double()
+	{
+		return m_reader.read_double_le();
+	}
+
+	std::string read_string()
+	{
+		uint64_t size = read<uint64_t>();
+		throw_if (size > max_string_size, "Invalid string size in PDF helper protocol", size);
+		std::string value(size, '\0');
+		m_reader.read({reinterpret_cast<std::byte*>(value.data()), value.size()});
+		return value;
+	}
+
+private:
+	static constexpr uint64_t max_string_size = 1 << 30;
+	binary::reader m_reader;
+};
+
+void write_page_objects(protocol_writer& writer, const std::vector<page_object>& objects)
+{
+	writer.write(static_cast<uint32_t>(objects.size()));
+	auto write_position = [&writer](const attributes::position& position)
+	{
+		writer.write(position.x.value_or(0));
+		writer.write(position.y.value_or(0));
+		writer.write(position.width.value_or(0));
+		writer.write(position.height.value_or(0));
+	};
+	for (const page_object& object : objects)
+	{
+		std::visit(overloaded {
+			[&](const document::text& text)
+			{
+				writer.write(page_object_kind::text);
+				writer.write(text.text);
+				write_position(text.position);
+				writer.write(text.font_size.value_or(0));
+			},
+			[&](const image_object& image)
+			{
+				writer.write(page_object_kind::image);
+				writer.write(static_cast<int32_t>(image.index));
+				write_position(image.position);
+			},
+			[&](const std::exception_ptr& error)
+			{
+				writer.write(page_object_kind::error);
+				writer.write(errors::diagnostic_message(error));
+			}
+		}, object);
+	}
+}
+
+std::vector<page_object> read_page_objects(protocol_reader& reader)
+{
+	uint32_t count = reader.read<uint32_t>();
+	auto read_position = [&reader]()
+	{
+		attributes::position position;
+		position.x = reader.read_double();
+		position.y = reader.read_double();
+		position.width = reader.read_double();
+		position.height = reader.read_double();
+		return position;
+	};
+	std::vector<page_object> objects;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		switch (reader.read<page_object_kind>())
 		{
-			const unsigned char* src_line = pixels + y * stride;
-			l_uint32* line = pix_data + y * wpl;
-			for (int x = 0; x < width; ++x)
+			case page_object_kind::text:
+			{
+				document::text text{.text = reader.read_string()};
+				text.position = read_position();
+				text.font_size = reader.read_double();
+				objects.push_back(std::move(text));
+				break;
+			}
+			case page_object_kind::image:
 			{
-				l_uint8 b = src_line[x * 4 + 0];
-				l_uint8 g = src_line[x * 4 + 1];
-				l_uint8 r = src_line[x * 4 + 2];
-				l_uint8 a = src_line[x * 4 + 3];
-				l_uint32 rgba_pixel = 0;
-				throw_if(
-					composeRGBAPixel(r, g, b, a, &rgba_pixel) != 0,
-					"composeRGBAPixel failed for BGRA pixel",
-					x, y
-				);
-				line[x] = rgba_pixel;
+				int index = reader.read<int32_t>();
+				objects.push_back(image_object{.index = index, .position = read_position()});
+				break;
 			}
+			case page_object_kind::error:
+				objects.push_back(make_error_ptr("PDF helper process failed to read object", reader.read_string()));
+				break;
+			default:
+				throw make_error("Invalid page object kind in PDF helper protocol", errors::program_logic{});
 		}
 	}
-	else
+	return objects;
+}
+
+// Document mapped from the shared memory object created by the parser.
+class helper_document_mapping
+{
+public:
+	helper_document_mapping(const std::string& name, size_t size)
+		: m_size{size}
+	{
+		int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+		throw_if (fd < 0, "shm_open failed", name, errno);
+		m_data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		throw_if (m_data == MAP_FAILED, "mmap failed", name, errno);
+	}
+
+	~helper_document_mapping()
 	{
-		throw make_error("Unsupported FPDFBitmap format for Pix creation", format, errors::uninterpretable_data{});
+		::munmap(m_data, m_size);
+	}
+
+	helper_document_mapping(const helper_document_mapping&) = delete;
+	helper_document_mapping& operator=(const helper_document_mapping&) = delete;
+
+	const void* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	void* m_data;
+	size_t m_size;
+};
+
+// Main loop of a helper process. Returns when the parser closes its end of the socket.
+void serve_helper_requests(int socket)
+{
+	init_pdfium_once();
+	protocol_reader reader{socket};
+	std::unique_ptr<helper_document_mapping> mapping;
+	shared_fpdf_document document;
+	for (;;)
+	{
+		helper_request request;
+		std::string name;
+		uint64_t size = 0;
+		int32_t page_num = 0;
+		try
+		{
+			request = reader.read<helper_request>();
+			if (request == helper_request::open_document)
+			{
+				name = reader.read_string();
+				size = reader.read<uint64_t>();
+			}
+			else if (request == helper_request::read_page)
+				page_num = reader.read<int32_t>();
+		}
+		catch (const std::exception&)
+		{
+			return;
+		}
+		protocol_writer writer;
+		try
+		{
+			switch (request)
+			{
+				case helper_request::open_document:
+				{
+					document.reset();
+					mapping = std::make_unique<helper_document_mapping>(name, size);
+					std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+					document = shared_fpdf_document{FPDF_LoadMemDocument(mapping->data(), mapping->size(), nullptr), [](FPDF_DOCUMENT doc)
+					{
+						if (!doc)
+							return;
+						std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+						FPDF_CloseDocument(doc);
+					}};
+					throw_if (!document, "FPDF_LoadMemDocument() failed", FPDF_GetLastError());
+					writer.write(helper_status::ok);
+					break;
+				}
+				case helper_request::read_page:
+				{
+					throw_if (!document, "No document is open", errors::program_logic{});
+					lazy_fpdf_page page{.document = document, .page_num = page_num};
+					std::vector<page_object> objects;
+					{
+						std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+						objects = read_page_objects(page.get());
+					}
+					writer.write(helper_status::ok);
+					write_page_objects(writer, objects);
+					break;
+				}
+				case helper_request::close_document:
+					document.reset();
+					mapping.reset();
+					continue;
+				default:
+					return;
+			}
+		}
+		catch (const std::exception&)
+		{
+			writer = protocol_writer{};
+			writer.write(helper_status::failed);
+			writer.write(errors::diagnostic_message(std::current_exception()));
+		}
+		try
+		{
+			writer.send(socket);
+		}
+		catch (const std::exception&)
+		{
+			return;
+		}
 	}
-	return pix;
 }
 
-using scoped_fpdf_document_with_custom_deleter = std::unique_ptr<
-		std::remove_pointer_t<FPDF_DOCUMENT>,
-		std::function<void(FPDF_DOCUMENT)>>;
+// Pre-forked helper processes, each with its own copy of PDFium, shared by all parsers of the process.
+// A helper reads pages without the pdfium_mutex of the parser process, so documents parsed
+// on different threads are read in parallel. A helper is leased for the whole document.
+class helper_process_pool
+{
+	struct helper
+	{
+		pid_t pid;
+		int socket;
+		std::optional<std::thread::id> holder;
+		bool failed = false;
+	};
+
+public:
+	// The pool grows to the largest size requested, replacing helpers that failed, and runs until the process exits.
+	static helper_process_pool& instance(unsigned int size)
+	{
+		static helper_process_pool pool;
+		pool.grow(size);
+		return pool;
+	}
+
+	~helper_process_pool()
+	{
+		for (std::unique_ptr<helper>& h : m_helpers)
+			stop_helper(*h);
+	}
+
+	class lease
+	{
+	public:
+		lease(helper_process_pool& pool, helper& h) : m_pool{&pool}, m_helper{&h} {}
+		lease(lease&& other) noexcept : m_pool{std::exchange(other.m_pool, nullptr)}, m_helper{other.m_helper} {}
+		lease& operator=(lease&&) = delete;
+
+		~lease()
+		{
+			if (m_pool)
+				m_pool->release(*m_helper);
+		}
+
+		int socket() const { return m_helper->socket; }
+
+		// The helper is stopped when it is released, as its state is unknown.
+		void mark_failed() { m_helper->failed = true; }
+
+	private:
+		helper_process_pool* m_pool;
+		helper* m_helper;
+	};
+
+	// Waits for a free helper. Returns std::nullopt if no helper is running, or if the calling thread
+	// already holds one, so a document nested in a document does not wait for itself.
+	std::optional<lease> acquire()
+	{
+		std::unique_lock<std::mutex> lock{m_mutex};
+		for (;;)
+		{
+			if (std::none_of(m_helpers.begin(), m_helpers.end(), [](const std::unique_ptr<helper>& h) { return is_running(*h); }) ||
+				std::any_of(m_helpers.begin(), m_helpers.end(), [](const std::unique_ptr<helper>& h) { return h->holder == std::this_thread::get_id(); }))
+				return std::nullopt;
+			auto free_helper = std::find_if(m_helpers.begin(), m_helpers.end(), [](const std::unique_ptr<helper>& h) { return is_running(*h) && !h->holder; });
+			if (free_helper != m_helpers.end())
+			{
+				(*free_helper)->holder = std::this_thread::get_id();
+				return lease{*this, **free_helper};
+			}
+			m_helper_released.wait(lock);
+		}
+	}
+
+private:
+	helper_process_pool() = default;
+
+	static bool is_running(const helper& h) { return h.pid > 0; }
+
+	void grow(unsigned int size)
+	{
+		log_scope(size);
+		std::lock_guard<std::mutex> lock{m_mutex};
+		auto running = [this]()
+		{
+			return static_cast<unsigned int>(std::count_if(m_helpers.begin(), m_helpers.end(), [](const std::unique_ptr<helper>& h) { return is_running(*h); }));
+		};
+		if (running() >= size)
+			return;
+		init_pdfium_once();
+		// No thread of the parser process is inside PDFium while its state is copied to the helpers
+		std::unique_lock<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+		while (running() < size)
+			start_helper(pdfium_mutex_lock);
+	}
+
+	void start_helper(std::unique_lock<std::mutex>& pdfium_mutex_lock)
+	{
+		int sockets[2];
+		throw_if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0, "socketpair failed", errno);
+#ifdef SO_NOSIGPIPE
+		int enabled = 1;
+		::setsockopt(sockets[0], SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+		::setsockopt(sockets[1], SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+		pid_t pid = ::fork();
+		if (pid == 0)
+		{
+			// The copy of pdfium_mutex is locked by this thread and the parser ends of other helpers must be closed,
+			// so helpers see the end of input when the parser closes them.
+			pdfium_mutex_lock.unlock();
+			::close(sockets[0]);
+			for (const std::unique_ptr<helper>& h : m_helpers)
+				if (is_running(*h))
+					::close(h->socket);
+			try
+			{
+				serve_helper_requests(sockets[1]);
+			}
+			catch (...)
+			{
+				::_exit(1);
+			}
+			::_exit(0);
+		}
+		::close(sockets[1]);
+		if (pid < 0)
+		{
+			::close(sockets[0]);
+			throw make_error("fork failed", errno);
+		}
+		m_helpers.push_back(std::make_unique<helper>(helper{.pid = pid, .socket = sockets[0]}));
+	}
+
+	static void stop_helper(helper& h)
+	{
+		if (!is_running(h))
+			return;
+		::close(h.socket);
+		if (h.failed)
+			::kill(h.pid, SIGKILL);
+		while (::waitpid(h.pid, nullptr, 0) < 0 && errno == EINTR) {}
+		h.pid = -1;
+	}
+
+	void release(helper& h)
+	{
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+			h.holder.reset();
+			if (h.failed)
+				stop_helper(h);
+		}
+		m_helper_released.notify_all();
+	}
+
+	std::vector<std::unique_ptr<helper>> m_helpers;
+	std::mutex m_mutex;
+	std::condition_variable m_helper_released;
+};
+
+// Document opened in a leased helper for the time of parsing.
+// The document is passed through a shared memory object that is unlinked as soon as the helper maps it.
+class helper_document
+{
+public:
+	helper_document(helper_process_pool::lease lease, std::span<const std::byte> data)
+		: m_lease{std::move(lease)}
+	{
+		log_scope(data.size());
+		static std::atomic<unsigned int> document_counter{0};
+		std::string name = "/docwire_pdf_" + std::to_string(::getpid()) + "_" + std::to_string(document_counter++);
+		int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		throw_if (fd < 0, "shm_open failed", name, errno);
+		try
+		{
+			throw_if (::ftruncate(fd, data.size()) != 0, "ftruncate failed", errno);
+			void* memory = ::mmap(nullptr, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			throw_if (memory == MAP_FAILED, "mmap failed", errno);
+			std::memcpy(memory, data.data(), data.size());
+			::munmap(memory, data.size());
+			protocol_writer request;
+			request.write(helper_request::open_document);
+			request.write(name);
+			request.write(static_cast<uint64_t>(data.size()));
+			exchange(request);
+		}
+		catch (const std::exception&)
+		{
+			::close(fd);
+			::shm_unlink(name.c_str());
+			throw;
+		}
+		::close(fd);
+		::shm_unlink(name.c_str());
+	}
+
+	~helper_document()
+	{
+		if (m_failed)
+			return;
+		try
+		{
+			protocol_writer request;
+			request.write(helper_request::close_document);
+			request.send(m_lease.socket());
+		}
+		catch (const std::exception&)
+		{
+			m_lease.mark_failed();
+		}
+	}
+
+	helper_document(const helper_document&) = delete;
+	helper_document& operator=(const helper_document&) = delete;
+
+	std::vector<page_object> read_page(int page_num)
+	{
+		log_scope(page_num);
+		protocol_writer request;
+		request.write(helper_request::read_page);
+		request.write(static_cast<int32_t>(page_num));
+		protocol_reader reader = exchange(request);
+		try
+		{
+			return read_page_objects(reader);
+		}
+		catch (const std::exception&)
+		{
+			fail();
+			std::throw_with_nested(make_error("PDF helper process failed"));
+		}
+	}
+
+private:
+	// Sends the request and reads the status. A failure reported by the helper leaves it usable,
+	// but a broken connection or an unexpected response stops it.
+	protocol_reader exchange(const protocol_writer& request)
+	{
+		throw_if (m_failed, "PDF helper process failed earlier");
+		protocol_reader reader{m_lease.socket()};
+		helper_status status;
+		std::string message;
+		try
+		{
+			request.send(m_lease.socket());
+			status = reader.read<helper_status>();
+			if (status == helper_status::failed)
+				message = reader.read_string();
+			else
+				throw_if (status != helper_status::ok, "Invalid status in PDF helper protocol", errors::program_logic{});
+		}
+		catch (const std::exception&)
+		{
+			fail();
+			std::throw_with_nested(make_error("PDF helper process failed"));
+		}
+		if (status == helper_status::failed)
+			throw make_error("PDF helper process could not process the request", message);
+		return reader;
+	}
+
+	void fail()
+	{
+		m_failed = true;
+		m_lease.mark_failed();
+	}
+
+	helper_process_pool::lease m_lease;
+	bool m_failed = false;
+};
+
+#endif // _WIN32
 
 struct context
 {
 	const message_callbacks& emit_message;
-	scoped_fpdf_document_with_custom_deleter pdf_document;
+	shared_fpdf_document pdf_document;
+#ifndef _WIN32
+	std::unique_ptr<helper_document> helper;
+#endif
 };
 
 const std::vector<mime_type> supported_mime_types =
@@ -231,7 +977,21 @@ bool begins_with_whitespace(const std::string& s) {
 template<>
 struct pimpl_impl<pdf_parser> : pimpl_impl_base
 {
+	pimpl_impl(pdf::pages pages_arg, pdf::metadata_only metadata_only_arg, pdf::helper_processes helper_processes_arg)
+		: m_pages{pages_arg}, m_metadata_only{metadata_only_arg}
+	{
+#ifndef _WIN32
+		if (helper_processes_arg.v > 0)
+			m_helper_pool = &helper_process_pool::instance(helper_processes_arg.v);
+#endif
+	}
+
+	pdf::pages m_pages;
+	pdf::metadata_only m_metadata_only;
 	std::stack<context> m_context_stack;
+#ifndef _WIN32
+	helper_process_pool* m_helper_pool = nullptr;
+#endif
 
 	template <typename T>
 	continuation emit_message(T&& object) const
@@ -250,13 +1010,66 @@ struct pimpl_impl<pdf_parser> : pimpl_impl_base
 		return m_context_stack.top().pdf_document.get();
 	}
 
+	using extracted_object = std::variant<document::text, document::image, std::exception_ptr>;
+
+	// Reads all text objects and image bounds of the page in a single pdfium_mutex critical section,
+	// or in the helper process if the document is open in one.
+	// Image pixels are not decoded here. Images get a provider that decodes them on first use.
+	// Messages are emitted by the caller after the lock is released, so downstream processing
+	// of one document does not block PDFium calls of other threads.
+	std::vector<extracted_object> extract_page_objects(int page_num)
+	{
+		log_scope(page_num);
+		auto page = std::make_shared<lazy_fpdf_page>(lazy_fpdf_page{.document = m_context_stack.top().pdf_document, .page_num = page_num});
+		std::vector<page_object> page_objects;
+#ifndef _WIN32
+		if (m_context_stack.top().helper)
+			page_objects = m_context_stack.top().helper->read_page(page_num);
+		else
+#endif
+		{
+			std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+			page_objects = read_page_objects(page->get());
+		}
+		std::vector<extracted_object> objects;
+		objects.reserve(page_objects.size());
+		for (page_object& object : page_objects)
+		{
+			std::visit(overloaded {
+				[&](document::text& text)
+				{
+					objects.push_back(std::move(text));
+				},
+				[&](image_object& image)
+				{
+					raster_image_provider raster = lazy_image_object_raster(page, image.index);
+					objects.push_back(document::image{
+						.source = png_data_source(raster),
+						.alt = std::nullopt, // PDFium does not easily provide this for FPDF_PAGEOBJ_IMAGE
+						.position = image.position,
+						.raster = std::move(raster)
+					});
+				},
+				[&](std::exception_ptr& error)
+				{
+					objects.push_back(std::move(error));
+				}
+			}, object);
+		}
+		return objects;
+	}
+
 	void parseText()
 	{
 		log_scope();
-		std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
-		int page_count = FPDF_GetPageCount(pdf_document());
-		log_entry(page_count);
-		for (size_t page_num = 0; page_num < page_count; page_num++)
+		int page_count;
+		{
+			std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
+			page_count = FPDF_GetPageCount(pdf_document());
+		}
+		size_t end_page = std::min(m_pages.to.value_or(page_count), static_cast<size_t>(page_count));
+		log_entry(page_count, m_pages.from, end_page);
+		for (size_t page_num = m_pages.from; page_num < end_page; page_num++)
 		{
 			log_scope(page_num);
 			auto response = emit_message(document::page{});
@@ -270,128 +1083,21 @@ struct pimpl_impl<pdf_parser> : pimpl_impl_base
 			}
 			try
 			{
-				std::multiset<page_element_variant, page_element_variant_comparator> page_elements;
-				ScopedFPDFPage page { FPDF_LoadPage(pdf_document(), page_num) };
-				throw_if(!page);
-				// text_page is only needed for FPDFTextObj_GetText, so load it if/when a text object is found.
-				ScopedFPDFTextPage text_page { nullptr };
-
-				int object_count = FPDFPage_CountObjects(page.get());
-				throw_if (object_count < 0, "FPDFPage_CountObjects returned negative count");
-				thread_local charset_converter conv("UTF-16LE", "UTF-8");
 				bool stop_processing = false;
-				for (int i = 0; i < object_count; ++i)
+				std::multiset<page_element_variant, page_element_variant_comparator> page_elements;
+				for (extracted_object& object : extract_page_objects(page_num))
 				{
-					try
-					{
-    				FPDF_PAGEOBJECT object = FPDFPage_GetObject(page.get(), i);
-    				throw_if (!object);
-    				int object_type = FPDFPageObj_GetType(object);
-    				switch (object_type)
-					{
-        				case FPDF_PAGEOBJ_TEXT:
-        				{
-							if (!text_page) { // Load text_page on demand
-								text_page.reset(FPDFText_LoadPage(page.get()));
-								throw_if(!text_page, "FPDFText_LoadPage failed");
-							}
-							unsigned long buffer_size = FPDFTextObj_GetText(object, text_page.get(), nullptr, 0);
-            				std::string utf8_text;
-							if (buffer_size > 0) { // FPDFTextObj_GetText needs at least 2 bytes for empty string (null terminator)
-                				std::vector<unsigned short> buffer(buffer_size / sizeof(unsigned short)); // buffer_size is in bytes
-                				unsigned long bytes_returned = FPDFTextObj_GetText(object, text_page.get(), buffer.data(), buffer_size);
-                				throw_if(bytes_returned > buffer_size || (bytes_returned == 0 && buffer_size >0) , "FPDFTextObj_GetText failed to retrieve text or returned unexpected size");
-                    			if (bytes_returned > 0) { // bytes_returned includes the null terminator(s)
-									utf8_text = conv.convert(std::string{
-										reinterpret_cast<const char*>(buffer.data()),
-										bytes_returned - sizeof(unsigned short) // Exclude UTF-16LE NULL terminator
-									});
-								}
-							}
-
-							float left, bottom, right, top;
-							throw_if(!FPDFPageObj_GetBounds(object, &left, &bottom, &right, &top));
-
-							float font_size_val = 0.0f;
-							FPDF_FONT font = FPDFTextObj_GetFont(object);
-							if (font)
-							{
-								log_scope();
-								if (!FPDFTextObj_GetFontSize(object, &font_size_val) || font_size_val <= 0) {
-            						log_entry();
-									font_size_val = 10.0f; // Default if not found
-								}
-    						}
-							page_elements.insert(document::text{
-								.text = utf8_text,
-								.position = {
-									.x = std::optional<double>{static_cast<double>(left)},
-									.y = std::optional<double>{static_cast<double>(bottom)},
-									.width = std::optional<double>{static_cast<double>(right - left)},
-									.height = std::optional<double>{static_cast<double>(top - bottom)}
-								},
-								.font_size = static_cast<double>(font_size_val)
-							});
-            				break;
-        				}
-						case FPDF_PAGEOBJ_IMAGE:
+					std::visit(overloaded {
+						[&](auto& element)
 						{
-							ScopedFPDFBitmap bitmap { FPDFImageObj_GetBitmap(object) };
-							int width = FPDFBitmap_GetWidth(bitmap.get());
-							int height = FPDFBitmap_GetHeight(bitmap.get());
-							int stride = FPDFBitmap_GetStride(bitmap.get());
-							const unsigned char* pixels = (const unsigned char*)FPDFBitmap_GetBuffer(bitmap.get());
-        					int format = FPDFBitmap_GetFormat(bitmap.get());
-
-							FPDF_IMAGEOBJ_METADATA image_metadata;
-							l_int32 h_res = 72; // Default DPI
-							l_int32 v_res = 72;   // Default DPI
-							if (FPDFImageObj_GetImageMetadata(object, page.get(), &image_metadata)) {
-								if (image_metadata.horizontal_dpi > 0.0f)
-									h_res = static_cast<l_int32>(image_metadata.horizontal_dpi);
-								if (image_metadata.vertical_dpi > 0.0f)
-									v_res = static_cast<l_int32>(image_metadata.vertical_dpi);
-							}
-
-            				pix_unique_ptr pix = create_pix_from_fpdf_bitmap(width, height, stride, format, pixels, h_res, v_res);
-			                l_uint8* png_data_raw = nullptr;
-            			    size_t png_size = 0;
-                			leptonica_data_ptr png_data(nullptr, lept_free);
-                			throw_if (pixWriteMemPng(&png_data_raw, &png_size, pix.get(), 0.0f) != 0);
-							throw_if (!png_data_raw);
-							throw_if (png_size <= 0);
-                    		png_data.reset(png_data_raw);
-							std::vector<std::byte> image_data;
-                    		image_data.resize(png_size);
-							memcpy(image_data.data(), png_data.get(), png_size);
-                			data_source image_source(std::move(image_data), mime_type { "image/png" }, confidence::highest);
-
-							float left, bottom, right, top;
-							throw_if(!FPDFPageObj_GetBounds(object, &left, &bottom, &right, &top));
-							page_elements.insert(document::image{
-                                .source = std::move(image_source),
-                                .alt = std::nullopt, // PDFium does not easily provide this for FPDF_PAGEOBJ_IMAGE
-                                .position = {
-                                    .x = std::optional<double>{static_cast<double>(left)},
-                                    .y = std::optional<double>{static_cast<double>(bottom)},
-                                    .width = std::optional<double>{static_cast<double>(right - left)},
-                                    .height = std::optional<double>{static_cast<double>(top - bottom)}
-                                }
-                            });
-							break;
+							page_elements.insert(std::move(element));
+						},
+						[&](std::exception_ptr& error)
+						{
+							emit_message(std::move(error));
 						}
-						default:
-							break;
-					}
-					}
-					catch (const std::exception&)
-					{
-						emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process object", i)));
-					}
-					if (stop_processing) break;
+					}, object);
 				}
-				if (stop_processing)
-					break;
 
 				const page_element_variant* prev_element_variant = nullptr;
 				for (const auto& element : page_elements)
@@ -589,42 +1295,21 @@ struct pimpl_impl<pdf_parser> : pimpl_impl_base
 		metadata.page_count = FPDF_GetPageCount(pdf_document());
 	}
 
-	void init_pdfium_once()
-	{
-		class pdfium_lifecycle_manager
-		{
-		public:
-			pdfium_lifecycle_manager()
-			{
-				FPDF_LIBRARY_CONFIG config;
-				config.version = 2;
-				config.m_pUserFontPaths = nullptr;
-				config.m_pIsolate = nullptr;
-				config.m_v8EmbedderSlot = 0;
-				std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
-				FPDF_InitLibraryWithConfig(&config);
-			}
-
-			~pdfium_lifecycle_manager()
-			{
-				std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
-				FPDF_DestroyLibrary();
-			}
-		};
-		static pdfium_lifecycle_manager pdfium_manager;
-	}
-
-	void loadDocument(const data_source& data)
+	// PDFium reads from the data source memory for as long as the document is open, and lazily decoded
+	// images can keep the document open after parsing, so the document co-owns the source message.
+	void loadDocument(const message_ptr& source_message)
 	{
 		log_scope();
-		std::span<const std::byte> span = data.span();
+		std::span<const std::byte> span = source_message->get<data_source>().span();
 		init_pdfium_once();
 		std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
-		m_context_stack.top().pdf_document = scoped_fpdf_document_with_custom_deleter
+		m_context_stack.top().pdf_document = shared_fpdf_document
 			{
 				FPDF_LoadMemDocument(span.data(), span.size(), nullptr),
-				[&](FPDF_DOCUMENT doc)
+				[source_message](FPDF_DOCUMENT doc)
 				{
+					if (!doc)
+						return;
 					std::lock_guard<std::mutex> pdfium_mutex_lock(pdfium_mutex);
 					FPDF_CloseDocument(doc);
 				}
@@ -639,10 +1324,12 @@ struct pimpl_impl<pdf_parser> : pimpl_impl_base
 	}
 
 	attributes::metadata metaData(const data_source& data);
-	void parse(const data_source& data, const message_callbacks& emit_message);
+	void parse(const message_ptr& source_message, const message_callbacks& emit_message);
 };
 
-pdf_parser::pdf_parser() = default;
+pdf_parser::pdf_parser(pdf::pages pages_arg, pdf::metadata_only metadata_only_arg, pdf::helper_processes helper_processes_arg)
+	: with_pimpl<pdf_parser>{pages_arg, metadata_only_arg, helper_processes_arg}
+{}
 
 attributes::metadata pimpl_impl<pdf_parser>::metaData(const data_source& data)
 {
@@ -651,22 +1338,42 @@ attributes::metadata pimpl_impl<pdf_parser>::metaData(const data_source& data)
 	return metadata;
 }
 
-void pimpl_impl<pdf_parser>::parse(const data_source& data, const message_callbacks& emit_message)
+void pimpl_impl<pdf_parser>::parse(const message_ptr& source_message, const message_callbacks& emit_message)
 {
+	const data_source& data = source_message->get<data_source>();
 	log_scope(data);
 	message_counters counters;
 	auto counting_callbacks = make_counted_message_callbacks(emit_message, counters);
 	scoped::stack_push<context> context_guard{m_context_stack, {.emit_message = counting_callbacks}};
-	loadDocument(data);
-	emit_message(document::document
-		{
-			.metadata = [this, &data]()
-
+	loadDocument(source_message);
+	if (m_metadata_only.v)
+	{
+		// Metadata is the only payload in this mode, so it is read eagerly and stays valid after the document is closed.
+		emit_message(document::document
 			{
-				return metaData(data);
-			}
-		}); 
-	parseText();
+				.metadata = [metadata = metaData(data)]()
+				{
+					return metadata;
+				}
+			});
+	}
+	else
+	{
+#ifndef _WIN32
+		if (m_helper_pool)
+			if (std::optional<helper_process_pool::lease> lease = m_helper_pool->acquire())
+				m_context_stack.top().helper = std::make_unique<helper_document>(std::move(*lease), data.span());
+#endif
+		emit_message(document::document
+			{
+				.metadata = [this, &data]()
+
+				{
+					return metaData(data);
+				}
+			}); 
+		parseText();
+	}
 	if (counters.all_failed())
 		throw make_error("No objects were successfully processed", errors::uninterpretable_data{});
 	emit_message(document::close_document{});
@@ -685,7 +1392,7 @@ continuation pdf_parser::operator()(message_ptr msg, const message_callbacks& em
 
 	try
 	{
-		impl().parse(data, emit_message);
+		impl().parse(msg, emit_message);
 	}
 	catch (const std::exception& e)
 	{
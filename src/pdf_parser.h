@@ -16,9 +16,39 @@
 #include "pdf_export.h"
 #include "pimpl.h"
 #include "message.h"
+#include <cstddef>
+#include <optional>
 
 namespace docwire
 {
+
+namespace pdf
+{
+
+/// Zero-based, half-open range of pages to parse. Pages outside the range are not loaded at all.
+struct pages
+{
+	size_t from = 0;
+	std::optional<size_t> to; ///< One past the last page to parse, or std::nullopt for all remaining pages.
+};
+
+/// If true, only the document metadata (including the page count) is emitted and no page is loaded.
+struct metadata_only { bool v; };
+
+/**
+ * Number of helper processes that read pages with their own copy of PDFium. 0 reads pages in the calling process.
+ *
+ * PDFium is not thread-safe, so in the calling process pages of all documents are read one at a time.
+ * A helper reads the pages of one document at a time, so documents parsed on different threads are read in parallel.
+ * Helpers are shared by all parsers of the process and run until it exits. They are forked when a parser asking
+ * for more helpers than are running is created, so the first such parser should be created before other threads start.
+ * Images are still decoded in the calling process, and only if a consumer reads them.
+ * Supported on POSIX systems only. Elsewhere pages are always read in the calling process.
+ */
+struct helper_processes { unsigned int v; };
+
+} // namespace pdf
+
 class DOCWIRE_PDF_EXPORT pdf_parser : public chain_element, public with_pimpl<pdf_parser>
 {
 	private:
@@ -26,7 +56,8 @@ class DOCWIRE_PDF_EXPORT pdf_parser : public chain_element, public with_pimpl<pd
 		friend pimpl_impl<pdf_parser>;
 
 	public:
-		pdf_parser();
+		pdf_parser(pdf::pages pages_arg = {}, pdf::metadata_only metadata_only_arg = pdf::metadata_only{false},
+			pdf::helper_processes helper_processes_arg = pdf::helper_processes{0});
 		continuation operator()(message_ptr msg, const message_callbacks& emit_message) override;
 		bool is_leaf() const override { return false; }
 };
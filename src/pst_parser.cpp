@@ -17,9 +17,16 @@
 #include <iomanip>
 #include <ctime>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <optional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stack>
+#include <thread>
 extern "C"
 {
 #define LIBPFF_HAVE_BFIO
@@ -81,7 +88,7 @@ struct unique_handle
 	
 	unique_handle& operator=(unique_handle&& in) noexcept
 	{
-		if (this != &in)
+		if (this != std::addressof(in))
 		{
 			if (handle) Deleter{}(handle);
 			handle = std::exchange(in.handle, nullptr);
@@ -114,16 +121,24 @@ using bfio_handle = unique_handle<libbfio_handle_t, decltype([](libbfio_handle_t
 	libbfio_handle_free(&ptr, &error);
 })>;
 
-struct raw_attachment
+/// Owns the input stream and the libbfio/libpff handles opened on it. Shared by everything that reads items lazily.
+struct pst_file
 {
-  raw_attachment(size_t size, std::unique_ptr<uint8_t[]>& raw_data, std::string name)
-  : m_size(size),
-    m_raw_data(std::move(raw_data)),
-    m_name(name)
-  {}
-  std::string m_name;
-  size_t m_size;
-  std::unique_ptr<uint8_t[]> m_raw_data;
+	message_ptr source; ///< Owns the data_source whose memory the stream reads from.
+	std::shared_ptr<std::istream> stream;
+	bfio_handle handle;
+	pff_file file;
+	/// Held while items of the file are read or freed, because libpff handles are not thread-safe.
+	/// Recursive, because decoding frees the items it rejects while already holding it.
+	std::recursive_mutex mutex;
+};
+
+/// Attachment item whose data has not been read yet.
+struct pst_attachment
+{
+	std::string name;
+	size64_t size;
+	pff_item item;
 };
 
 class pst_message
@@ -229,13 +244,21 @@ class pst_message
     return {};
 	}
 
-	std::vector<raw_attachment>
-	getAttachments()
+  std::optional<uint32_t> getIdentifier() const
+  {
+    uint32_t identifier;
+    if (libpff_item_get_identifier(_messageHandle, &identifier, nullptr) != 1)
+      return std::nullopt;
+    return identifier;
+  }
+
+	std::vector<pst_attachment>
+	getAttachments() const
 	{
 		log_scope();
 		int items;
 		pff_error err;
-    std::vector<raw_attachment> attachments;
+    std::vector<pst_attachment> attachments;
     if (libpff_message_get_number_of_attachments(_messageHandle, &items, &err) != 1)
 		{
 			return {};
@@ -254,14 +277,8 @@ class pst_message
 				log_entry();
 				continue;
 			}
-			std::unique_ptr<uint8_t[]> datablob(new uint8_t[size + 1]);
-			if (libpff_attachment_data_read_buffer(item, datablob.get(), size, &err) == -1)
-			{
-				log_entry();
-				continue;
-			}
       std::string attachment_name = getAttachmentName(item);
-      attachments.push_back(raw_attachment(size, datablob, attachment_name));
+      attachments.push_back(pst_attachment{.name = attachment_name, .size = size, .item = std::move(item)});
 		}
 		return attachments;
 	}
@@ -309,6 +326,24 @@ class folder
 		return msg;
 	}
 
+	std::optional<uint32_t> getMessageIdentifier(int index) const
+	{
+		pff_item mail;
+		uint32_t identifier;
+		if (libpff_folder_get_sub_message(_folderHandle, index, &mail, nullptr) != 1 ||
+			libpff_item_get_identifier(mail, &identifier, nullptr) != 1)
+			return std::nullopt;
+		return identifier;
+	}
+
+	std::optional<uint32_t> getIdentifier() const
+	{
+		uint32_t identifier;
+		if (libpff_item_get_identifier(_folderHandle, &identifier, nullptr) != 1)
+			return std::nullopt;
+		return identifier;
+	}
+
 	std::string getName() const
 	{
 		size_t name_size;
@@ -328,6 +363,185 @@ namespace
 struct context
 {
 	const message_callbacks& emit_message;
+	mail_checkpoint_store* checkpoint_store; ///< Set for the outermost mailbox only, as identifiers are unique within one file.
+};
+
+/// Attachment data is read from the PST file only when a consumer accesses the data_source.
+/// The producer keeps the file and the owning message alive, so it stays valid after parsing finishes.
+memory_buffer_producer attachment_data_producer(std::shared_ptr<pst_file> pst, std::shared_ptr<const pst_message> message, pst_attachment&& attachment)
+{
+	struct source
+	{
+		std::shared_ptr<pst_file> pst;
+		std::shared_ptr<const pst_message> message;
+		pst_attachment attachment;
+
+		~source()
+		{
+			std::lock_guard<std::recursive_mutex> lock{pst->mutex};
+			attachment.item = pff_item{};
+			message.reset();
+		}
+	};
+	auto src = std::make_shared<source>(std::move(pst), std::move(message), std::move(attachment));
+	return memory_buffer_producer{[src]()
+	{
+		log_scope(src->attachment.name);
+		std::lock_guard<std::recursive_mutex> lock{src->pst->mutex};
+		pff_error err;
+		throw_if (libpff_attachment_data_seek_offset(src->attachment.item, 0, SEEK_SET, &err) == -1,
+			"libpff_attachment_data_seek_offset failed", src->attachment.name);
+		auto buffer = std::make_shared<memory_buffer>(src->attachment.size);
+		ssize_t read = libpff_attachment_data_read_buffer(src->attachment.item, reinterpret_cast<uint8_t*>(buffer->data()), buffer->size(), &err);
+		throw_if (read == -1, "libpff_attachment_data_read_buffer failed", src->attachment.name);
+		if (static_cast<size_t>(read) < buffer->size())
+			buffer->resize(read);
+		return buffer;
+	}};
+}
+
+/// Message with everything that is read before its emission starts.
+/// It can be destroyed on any thread, so its libpff items are freed under the file mutex.
+struct decoded_mail
+{
+	std::shared_ptr<pst_file> pst;
+	std::shared_ptr<const pst_message> message;
+	std::optional<uint32_t> identifier;
+	std::optional<std::string> html_text;
+	std::string subject;
+	uint32_t creation_date = 0;
+	std::vector<pst_attachment> attachments;
+
+	decoded_mail() = default;
+	decoded_mail(decoded_mail&&) = default;
+	decoded_mail& operator=(decoded_mail&&) = default;
+
+	~decoded_mail()
+	{
+		if (!pst)
+			return;
+		std::lock_guard<std::recursive_mutex> lock{pst->mutex};
+		attachments.clear();
+		message.reset();
+	}
+};
+
+/// Returns std::nullopt if the filter rejects the mail. The filter is checked before the body is read.
+std::optional<decoded_mail> decode_mail(std::shared_ptr<pst_file> pst, pst_message&& message, const mail_filter& filter)
+{
+	log_scope();
+	std::lock_guard<std::recursive_mutex> lock{pst->mutex};
+	decoded_mail mail;
+	mail.pst = std::move(pst);
+	mail.message = std::make_shared<const pst_message>(std::move(message));
+	mail.identifier = mail.message->getIdentifier();
+	if (filter.has_creation_time_range())
+	{
+		mail.creation_date = mail.message->getCreationDate();
+		if (!filter.accepts_creation_time(mail.creation_date))
+			return std::nullopt;
+	}
+	mail.html_text = mail.message->getTextAsHtml();
+	if (mail.html_text)
+	{
+		mail.subject = mail.message->getName();
+		mail.creation_date = mail.message->getCreationDate();
+	}
+	mail.attachments = mail.message->getAttachments();
+	std::erase_if(mail.attachments, [&filter](const pst_attachment& attachment)
+	{
+		return !filter.accepts_attachment(file_extension{std::filesystem::path{attachment.name}});
+	});
+	return mail;
+}
+
+/// Decodes a message on a worker, through the worker's own libpff handle.
+std::optional<decoded_mail> decode_mail(std::shared_ptr<pst_file> pst, uint32_t identifier, const mail_filter& filter)
+{
+	log_scope(identifier);
+	std::lock_guard<std::recursive_mutex> lock{pst->mutex};
+	pff_item item;
+	throw_if (libpff_file_get_item_by_identifier(pst->file, identifier, &item, nullptr) != 1,
+		"libpff_file_get_item_by_identifier failed", identifier);
+	return decode_mail(pst, pst_message{std::move(item)}, filter);
+}
+
+/// Long-lived threads decoding queued messages, each through the libpff handle of its own file.
+class mail_decoding_pool
+{
+public:
+	mail_decoding_pool(std::vector<std::shared_ptr<pst_file>> files, const mail_filter& filter)
+		: m_filter{filter}
+	{
+		for (std::shared_ptr<pst_file>& file : files)
+			m_threads.emplace_back([this, file = std::move(file)]() { run(file); });
+	}
+
+	~mail_decoding_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+			m_stopped = true;
+		}
+		m_job_available.notify_all();
+		for (std::thread& thread : m_threads)
+			thread.join();
+	}
+
+	mail_decoding_pool(const mail_decoding_pool&) = delete;
+	mail_decoding_pool& operator=(const mail_decoding_pool&) = delete;
+
+	size_t size() const { return m_threads.size(); }
+
+	std::future<std::optional<decoded_mail>> decode(uint32_t identifier)
+	{
+		job new_job{.identifier = identifier};
+		std::future<std::optional<decoded_mail>> result = new_job.result.get_future();
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+			m_jobs.push_back(std::move(new_job));
+		}
+		m_job_available.notify_one();
+		return result;
+	}
+
+private:
+	struct job
+	{
+		uint32_t identifier;
+		std::promise<std::optional<decoded_mail>> result;
+	};
+
+	void run(const std::shared_ptr<pst_file>& file)
+	{
+		for (;;)
+		{
+			job next_job;
+			{
+				std::unique_lock<std::mutex> lock{m_mutex};
+				m_job_available.wait(lock, [this]() { return m_stopped || !m_jobs.empty(); });
+				if (m_stopped)
+					return;
+				next_job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			try
+			{
+				next_job.result.set_value(decode_mail(file, next_job.identifier, m_filter));
+			}
+			catch (const std::exception&)
+			{
+				next_job.result.set_exception(std::current_exception());
+			}
+		}
+	}
+
+	const mail_filter& m_filter;
+	std::mutex m_mutex;
+	std::condition_variable m_job_available;
+	std::deque<job> m_jobs;
+	bool m_stopped = false;
+	std::vector<std::thread> m_threads;
 };
 
 const std::vector<mime_type> supported_mime_types =
@@ -342,6 +556,9 @@ template<>
 struct pimpl_impl<pst_parser> : pimpl_impl_base
 {
 	std::stack<context> m_context_stack;
+	pst_parallelism m_parallelism;
+	mail_filter m_filter;
+	std::shared_ptr<mail_checkpoint_store> m_checkpoint_store;
 
 	template <typename T>
 	continuation emit_message(T&& object) const
@@ -355,74 +572,168 @@ struct pimpl_impl<pst_parser> : pimpl_impl_base
 		return m_context_stack.top().emit_message.back(std::forward<T>(object));
 	}
 
-	void parse(std::shared_ptr<std::istream> stream) const;
+	void parse(message_ptr source, std::shared_ptr<std::istream> stream) const;
 
   private:
     void parse_element(const char* buffer, size_t size, const std::string& extension="") const;
-    void parse_internal(const folder& root, int deep, unsigned int &mail_counter) const;
+    void parse_internal(const folder& root, int deep, unsigned int &mail_counter, const std::shared_ptr<pst_file>& pst,
+                        mail_decoding_pool* decoding_pool) const;
+    void parse_messages_in_parallel(const folder& root, int deep, unsigned int &mail_counter,
+                                    mail_decoding_pool& decoding_pool) const;
+    void emit_mail(decoded_mail&& mail, int deep, unsigned int &mail_counter) const;
+
+    bool is_committed(std::optional<uint32_t> identifier) const
+    {
+      mail_checkpoint_store* checkpoint_store = m_context_stack.top().checkpoint_store;
+      return checkpoint_store && identifier && checkpoint_store->contains(*identifier);
+    }
+
+    void commit(std::optional<uint32_t> identifier) const
+    {
+      mail_checkpoint_store* checkpoint_store = m_context_stack.top().checkpoint_store;
+      if (checkpoint_store && identifier)
+        checkpoint_store->commit(*identifier);
+    }
 };
 
-void pimpl_impl<pst_parser>::parse_internal(const folder& root, int deep, unsigned int &mail_counter) const
+void pimpl_impl<pst_parser>::parse_internal(const folder& root, int deep, unsigned int &mail_counter, const std::shared_ptr<pst_file>& pst,
+                                            mail_decoding_pool* decoding_pool) const
 {
 	log_scope(deep, mail_counter);
 	for (int i = 0; i < root.getSubFolderNumber(); ++i)
 	{
 		auto sub_folder = root.getSubFolder(i);
-    auto result = emit_message(mail::folder{.name = sub_folder.getName(), .level = deep});
+    std::string folder_name = sub_folder.getName();
+    if (!m_filter.accepts_folder(folder_name))
+    {
+      continue;
+    }
+    auto result = emit_message(mail::folder{.name = folder_name, .level = deep, .identifier = sub_folder.getIdentifier()});
     if (result == continuation::skip)
     {
       continue;
     }
-    parse_internal(sub_folder, deep + 1, mail_counter);
+    parse_internal(sub_folder, deep + 1, mail_counter, pst, decoding_pool);
 	emit_message(mail::close_folder{});
 	}
+	if (decoding_pool)
+	{
+		parse_messages_in_parallel(root, deep, mail_counter, *decoding_pool);
+		return;
+	}
 	for (int i = 0; i < root.getMessageNumber(); ++i)
 	{
-		auto message = root.getMessage(i);
+		pst_message message = root.getMessage(i);
+		if (is_committed(message.getIdentifier()))
+			continue;
+		if (std::optional<decoded_mail> mail = decode_mail(pst, std::move(message), m_filter))
+			emit_mail(std::move(*mail), deep, mail_counter);
+	}
+}
 
-    auto html_text = message.getTextAsHtml();
-    if(html_text)
+void pimpl_impl<pst_parser>::parse_messages_in_parallel(const folder& root, int deep, unsigned int &mail_counter,
+                                                        mail_decoding_pool& decoding_pool) const
+{
+	log_scope(deep, decoding_pool.size());
+	// Messages are decoded by the pool, each through the libpff handle of its worker, and emitted here.
+	// Messages of a folder are emitted before the folder is closed, whichever order is used.
+	std::deque<std::future<std::optional<decoded_mail>>> in_flight_mails;
+	auto emit_next_mail = [&]()
+	{
+		auto next = in_flight_mails.begin();
+		if (!m_parallelism.ordered)
+		{
+			auto ready = std::find_if(in_flight_mails.begin(), in_flight_mails.end(), [](const std::future<std::optional<decoded_mail>>& mail)
+			{
+				return mail.wait_for(std::chrono::seconds::zero()) == std::future_status::ready;
+			});
+			if (ready != in_flight_mails.end())
+				next = ready;
+		}
+		std::future<std::optional<decoded_mail>> future_mail = std::move(*next);
+		in_flight_mails.erase(next);
+		std::optional<decoded_mail> mail;
+		try
+		{
+			mail = future_mail.get();
+		}
+		catch (const std::exception&)
+		{
+			emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process mail")));
+			return;
+		}
+		if (mail)
+			emit_mail(std::move(*mail), deep, mail_counter);
+	};
+	for (int i = 0; i < root.getMessageNumber(); ++i)
+	{
+		std::optional<uint32_t> identifier = root.getMessageIdentifier(i);
+		if (!identifier)
+		{
+			emit_message(make_error_ptr("Failed to get mail identifier", i));
+			continue;
+		}
+		if (is_committed(identifier))
+			continue;
+		in_flight_mails.push_back(decoding_pool.decode(*identifier));
+		if (in_flight_mails.size() >= 2 * decoding_pool.size())
+			emit_next_mail();
+	}
+	while (!in_flight_mails.empty())
+		emit_next_mail();
+}
+
+void pimpl_impl<pst_parser>::emit_mail(decoded_mail&& mail, int deep, unsigned int &mail_counter) const
+{
+	log_scope(deep, mail_counter);
+    // Mails skipped downstream or with errors are not committed, so they are processed again by the next run
+    bool failed = false;
+    if(mail.html_text)
     {
-      auto result = emit_message(mail::mail{.subject = message.getName(), .date = message.getCreationDate(), .level = deep});
+      auto result = emit_message(mail::mail{.subject = mail.subject, .date = mail.creation_date, .level = deep, .identifier = mail.identifier});
       if (result == continuation::skip)
       {
-        continue;
+        return;
       }
       emit_message(mail::mail_body{});
       try
       {
-        emit_message_back(data_source{*html_text, mime_type { "text/html" }, confidence::very_high});
+        emit_message_back(data_source{*mail.html_text, mime_type { "text/html" }, confidence::very_high});
       }
       catch (const std::exception&)
       {
         emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process mail body")));
+        failed = true;
       }
       ++mail_counter;
       emit_message(mail::close_mail_body{});
     }
 
-		auto attachments = message.getAttachments();
-    for (auto &attachment : attachments)
+    for (auto &attachment : mail.attachments)
     {
-      file_extension extension { std::filesystem::path{attachment.m_name} };
+      file_extension extension { std::filesystem::path{attachment.name} };
       auto result = emit_message(
-        mail::attachment{.name = attachment.m_name, .size = attachment.m_size, .extension = extension});
+        mail::attachment{.name = attachment.name, .size = attachment.size, .extension = extension});
       if (result == continuation::skip)
       {
         continue;
       }
+      std::string name = attachment.name;
       try
       {
-        emit_message_back(data_source{std::string((const char*)attachment.m_raw_data.get(), attachment.m_size), extension});
+        emit_message_back(data_source{attachment_data_producer(mail.pst, mail.message, std::move(attachment)), extension});
       }
       catch (const std::exception&)
       {
-        emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process attachment", attachment.m_name)));
+        emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Failed to process attachment", name)));
+        failed = true;
       }
       emit_message(mail::close_attachment{});
     }
 	emit_message(mail::close_mail{});
-	}
+	// Everything of the mail was emitted and processed downstream, so it does not need to be read again
+	if (!failed)
+		commit(mail.identifier);
 }
 
 namespace
@@ -483,32 +794,55 @@ void libbfio_stream_initialize(libbfio_handle_t** handle, std::shared_ptr<std::i
 	throw_if (libbfio_handle_initialize_result != 1, "libbfio_handle_initialize failed", libbfio_handle_initialize_result);
 }
 
-} // anonymous namespace
-
-void pimpl_impl<pst_parser>::parse(std::shared_ptr<std::istream> stream) const
+std::shared_ptr<pst_file> open_pst_file(message_ptr source, std::shared_ptr<std::istream> stream)
 {
 	log_scope();
-	bfio_handle handle;
+	auto pst = std::make_shared<pst_file>();
+	pst->source = std::move(source);
+	pst->stream = stream;
 	bfio_error bfio_err;
 
-	libbfio_stream_initialize(&handle, stream);
-	throw_if(libbfio_handle_open(handle, LIBBFIO_OPEN_READ, &bfio_err) != 1, "libbfio_handle_open failed");
+	libbfio_stream_initialize(&pst->handle, stream);
+	throw_if(libbfio_handle_open(pst->handle, LIBBFIO_OPEN_READ, &bfio_err) != 1, "libbfio_handle_open failed");
 
-	pff_file file;
 	pff_error error{nullptr};
-	throw_if (libpff_file_initialize(&file, &error) != 1, "libpff_file_initialize failed");
-    throw_if (libpff_file_open_file_io_handle(file, handle, LIBBFIO_OPEN_READ, &error) != 1, "libpff_file_open_file_io_handle failed");
+	throw_if (libpff_file_initialize(&pst->file, &error) != 1, "libpff_file_initialize failed");
+    throw_if (libpff_file_open_file_io_handle(pst->file, pst->handle, LIBBFIO_OPEN_READ, &error) != 1, "libpff_file_open_file_io_handle failed");
+	return pst;
+}
+
+} // anonymous namespace
 
+void pimpl_impl<pst_parser>::parse(message_ptr source, std::shared_ptr<std::istream> stream) const
+{
+	log_scope();
+	std::shared_ptr<pst_file> pst = open_pst_file(source, stream);
+	// Every worker reads the same source through its own stream and libpff handle
+	std::optional<mail_decoding_pool> decoding_pool;
+	if (m_parallelism.concurrency > 1)
+	{
+		std::vector<std::shared_ptr<pst_file>> workers;
+		for (unsigned int i = 0; i < m_parallelism.concurrency; ++i)
+			workers.push_back(open_pst_file(source, source->get<data_source>().istream()));
+		decoding_pool.emplace(std::move(workers), m_filter);
+	}
+
+	pff_error error{nullptr};
 	pff_item root = nullptr;
-	throw_if (libpff_file_get_root_folder(file, &root, &error) != 1, "libpff_file_get_root_folder failed");
+	throw_if (libpff_file_get_root_folder(pst->file, &root, &error) != 1, "libpff_file_get_root_folder failed");
 	folder root_folder(std::move(root));
   unsigned int mail_counter = 0;
 	emit_message(document::document{.metadata = []() { return attributes::metadata{}; }});
-  parse_internal(root_folder, 0, mail_counter);
+  parse_internal(root_folder, 0, mail_counter, pst, decoding_pool ? &*decoding_pool : nullptr);
 	emit_message(document::close_document{});
 }
 
-pst_parser::pst_parser() = default;
+pst_parser::pst_parser(pst_parallelism parallelism, mail_filter filter, std::shared_ptr<mail_checkpoint_store> checkpoint_store)
+{
+	impl().m_parallelism = parallelism;
+	impl().m_filter = std::move(filter);
+	impl().m_checkpoint_store = std::move(checkpoint_store);
+}
 
 continuation pst_parser::operator()(message_ptr msg, const message_callbacks& emit_message)
 {
@@ -529,8 +863,10 @@ continuation pst_parser::operator()(message_ptr msg, const message_callbacks& em
         std::shared_ptr<std::istream> stream = data.istream();
         message_counters counters;
         auto counting_callbacks = make_counted_message_callbacks(emit_message, counters);
-        scoped::stack_push<context> context_guard{impl().m_context_stack, context{counting_callbacks}};
-        impl().parse(stream);
+        // Mailboxes attached inside the parsed one come back through the same parser and do not use the checkpoint store
+        mail_checkpoint_store* checkpoint_store = impl().m_context_stack.empty() ? impl().m_checkpoint_store.get() : nullptr;
+        scoped::stack_push<context> context_guard{impl().m_context_stack, context{counting_callbacks, checkpoint_store}};
+        impl().parse(msg, stream);
         if (counters.all_failed())
             throw make_error("No items were successfully processed", errors::uninterpretable_data{});
     }
@@ -16,11 +16,20 @@
 #include "mail_export.h"
 
 #include "chain_element.h"
+#include "mail_checkpoint.h"
+#include "mail_filter.h"
 #include "pimpl.h"
 
 namespace docwire
 {
 
+/// Parallel decoding of PST/OST messages, each worker with its own libpff handle opened over the same source.
+struct pst_parallelism
+{
+  unsigned int concurrency = 1; ///< Number of messages decoded at once. 1 decodes messages on the calling thread.
+  bool ordered = true; ///< If false, messages of a folder are emitted as soon as they are decoded. Folders keep their order.
+};
+
 class DOCWIRE_MAIL_EXPORT pst_parser : public chain_element, public with_pimpl<pst_parser>
 {
 private:
@@ -28,7 +37,13 @@ private:
   friend pimpl_impl<pst_parser>;
 
 public:
-  pst_parser();
+  /**
+   * @param parallelism Parallel decoding of messages
+   * @param filter Predicates that skip folders, mails and attachments before they are read
+   * @param checkpoint_store If set, messages it contains are skipped and every message processed without errors is committed to it.
+   * It applies to the outermost mailbox only, mailboxes attached inside it are parsed in full.
+   */
+  pst_parser(pst_parallelism parallelism = {}, mail_filter filter = {}, std::shared_ptr<mail_checkpoint_store> checkpoint_store = nullptr);
   continuation operator()(message_ptr msg, const message_callbacks& emit_message) override;
   bool is_leaf() const override { return false; }
 };
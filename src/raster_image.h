@@ -0,0 +1,59 @@
+/*********************************************************************************************************************************************/
+/*  DocWire SDK: Award-winning modern data processing in C++20. SourceForge Community Choice & Microsoft support. AI-driven processing.      */
+/*  Supports nearly 100 data formats, including email boxes and OCR. Boost efficiency in text extraction, web data extraction, data mining,  */
+/*  document analysis. Offline processing possible for security and confidentiality                                                          */
+/*                                                                                                                                           */
+/*  Copyright (c) SILVERCODERS Ltd, http://silvercoders.com                                                                                  */
+/*  Project homepage: https://github.com/docwire/docwire                                                                                     */
+/*                                                                                                                                           */
+/*  SPDX-License-Identifier: AGPL-3.0-only OR LicenseRef-DocWire-Commercial                                                                  */
+/*********************************************************************************************************************************************/
+
+#ifndef DOCWIRE_RASTER_IMAGE_H
+#define DOCWIRE_RASTER_IMAGE_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace docwire
+{
+
+/// Layout of a single pixel in raster_image rows.
+enum class pixel_format
+{
+	gray8,  ///< 8-bit grayscale.
+	bgr24,  ///< 8-bit blue, green and red channels.
+	bgrx32, ///< 8-bit blue, green and red channels followed by an unused byte.
+	bgra32  ///< 8-bit blue, green, red and alpha channels.
+};
+
+/**
+ * @brief Decoded, uncompressed bitmap.
+ *
+ * Allows parsers that already have decoded pixels (e.g. PDF parser) to pass them to image consumers
+ * (e.g. OCR) directly, without encoding them to an image file format and decoding them back.
+ */
+struct raster_image
+{
+	std::shared_ptr<const std::vector<std::byte>> pixels; ///< Pixel rows, shared so that copying the image is cheap.
+	int width;
+	int height;
+	int stride; ///< Number of bytes between the beginnings of two consecutive rows.
+	pixel_format format;
+	int horizontal_dpi;
+	int vertical_dpi;
+};
+
+/**
+ * @brief Function returning the decoded pixels of an image on demand.
+ *
+ * Lets parsers defer decoding until a consumer actually needs the pixels, so pipelines
+ * without an image consumer do not pay for decoding.
+ */
+using raster_image_provider = std::function<raster_image()>;
+
+} // namespace docwire
+
+#endif // DOCWIRE_RASTER_IMAGE_H
@@ -11,26 +11,28 @@
 
 #include "rtf_parser.h"
 
+#include "charset_converter.h"
 #include "convert_chrono.h" // IWYU pragma: keep
 #include "convert_numeric.h" // IWYU pragma: keep
 #include "document_elements.h"
-#include "data_stream.h"
 #include "data_source.h"
 #include "error_tags.h"
 #include "log_entry.h"
 #include "log_scope.h"
 #include <map>
 #include "misc.h"
-#include <mutex>
+#include <memory>
+#include "nested_exception.h"
 #include <stack>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string_view>
 #include "serialization_data_source.h" // IWYU pragma: keep
 #include "serialization_enum.h" // IWYU pragma: keep
 #include <time.h>
 #include "throw_if.h"
-#include "wv2/src/textconverter.h"
+#include <vector>
 #include "wv2/src/ustring.h"
 
 namespace docwire
@@ -44,7 +46,113 @@ using namespace wvWare;
 namespace
 {
 
-long parseNumber(data_stream& data_stream)
+/**
+ * @brief Reads RTF content directly from the memory of the data source.
+ *
+ * Unlike data_stream it is not virtual and does not copy anything, so reading a character is an inlined
+ * bounds check. Characters are returned as unsigned values, so bytes above 0x7F are not mistaken for EOF.
+ */
+class rtf_reader
+{
+public:
+	explicit rtf_reader(std::string_view input)
+		: m_input{input}, m_pos{0}
+	{}
+
+	int getc()
+	{
+		if (m_pos >= m_input.size())
+			return EOF;
+		return static_cast<unsigned char>(m_input[m_pos++]);
+	}
+
+	void unGetc(int ch)
+	{
+		if (ch != EOF && m_pos > 0)
+			--m_pos;
+	}
+
+	bool eof() const
+	{
+		return m_pos == m_input.size();
+	}
+
+	/// Reads the next character and all following characters up to the next control character, group delimiter or line break.
+	std::string_view read_text_run()
+	{
+		size_t begin = m_pos;
+		size_t end = m_input.find_first_of("\\{}\r\n", std::min(begin + 1, m_input.size()));
+		if (end == std::string_view::npos)
+			end = m_input.size();
+		m_pos = end;
+		return m_input.substr(begin, end - begin);
+	}
+
+private:
+	std::string_view m_input;
+	size_t m_pos;
+};
+
+/**
+ * @brief Converts text in an 8-bit or multibyte code page of the document to UString.
+ *
+ * Every parse owns its converter, so documents with different code pages can be parsed concurrently.
+ * Conversion descriptors are reused by charset_converter, so switching fonts does not reopen them.
+ */
+class code_page_converter
+{
+public:
+	explicit code_page_converter(const std::string& encoding)
+		: m_encoding{encoding}, m_converter{std::make_unique<charset_converter>(encoding, unicode_encoding)}
+	{}
+
+	/// Switches to another encoding. If it is not supported, text is dropped until the next switch.
+	void set_encoding(const std::string& encoding)
+	{
+		if (encoding == m_encoding)
+			return;
+		m_encoding = encoding;
+		try
+		{
+			m_converter = std::make_unique<charset_converter>(encoding, unicode_encoding);
+		}
+		catch (const std::exception&)
+		{
+			m_converter.reset();
+		}
+	}
+
+	UString convert(std::string_view input) const
+	{
+		if (!m_converter || input.empty())
+			return UString();
+		try
+		{
+			std::string output = m_converter->convert(input);
+			return UString(reinterpret_cast<const UChar*>(output.data()), output.size() / sizeof(UChar));
+		}
+		catch (const std::exception&)
+		{
+			// Keep as much text as possible, halving the input until the invalid bytes are isolated and dropped.
+			if (input.size() == 1)
+				return UString();
+			UString result = convert(input.substr(0, input.size() / 2));
+			result += convert(input.substr(input.size() / 2));
+			return result;
+		}
+	}
+
+private:
+#ifdef WORDS_BIGENDIAN
+	static constexpr const char* unicode_encoding = "UNICODEBIG";
+#else
+	static constexpr const char* unicode_encoding = "UNICODELITTLE";
+#endif
+	std::string m_encoding;
+	std::unique_ptr<charset_converter> m_converter;
+};
+
+long parseNumber(rtf_reader& data_stream)
 {
 	log_scope();
 	int ch;
@@ -63,7 +171,7 @@ long parseNumber(data_stream& data_stream)
 	return strtol(buf, (char **)NULL, 10);
 }
 
-int parseCharCode(data_stream& data_stream)
+int parseCharCode(rtf_reader& data_stream)
 {
 	log_scope();
 	int ch;
@@ -216,7 +324,7 @@ rtf_command commandNameToEnum(char* name)
 	return RTF_UNKNOWN;
 }
 
-bool parseCommand(data_stream& data_stream, rtf_command& cmd, long int& arg)
+bool parseCommand(rtf_reader& data_stream, rtf_command& cmd, long int& arg)
 {
 	log_scope();
 	char name[RTFNAMEMAXLEN + 1];
@@ -320,8 +428,8 @@ std::chrono::sys_seconds parse_dttm_time(int dttm)
 	return sys_days{ymd} + hours{hour} + minutes{min};
 }
 
-void execCommand(data_stream& data_stream, UString& text, int& skip, rtf_parser_state& state, rtf_command cmd, long int arg,
-	TextConverter*& converter, const std::function<void(std::exception_ptr)>& non_fatal_error_handler)
+void execCommand(rtf_reader& data_stream, UString& text, int& skip, rtf_parser_state& state, rtf_command cmd, long int arg,
+	std::unique_ptr<code_page_converter>& converter, const std::function<void(std::exception_ptr)>& non_fatal_error_handler)
 {
 	log_scope(cmd, arg);
 	switch (cmd)
@@ -404,8 +512,11 @@ void execCommand(data_stream& data_stream, UString& text, int& skip, rtf_parser_
 			log_scope();
 			if (skip == 0)
 			{
-				if (converter != NULL)
-					text += converter->convert((const char*)&arg, sizeof(arg));
+				if (converter)
+				{
+					char ch = static_cast<char>(arg);
+					text += converter->convert(std::string_view{&ch, 1});
+				}
 				else
 					text += UString((UChar)arg);
 			}
@@ -500,16 +611,15 @@ void execCommand(data_stream& data_stream, UString& text, int& skip, rtf_parser_
 		case RTF_CODEPAGE:
 		{
 			log_scope(arg);
-			converter = new TextConverter(codepage_to_encoding(arg));
-			if (converter->isOk())
+			try
 			{
+				converter = std::make_unique<code_page_converter>(codepage_to_encoding(arg));
 				log_entry();
 			}
-			else
+			catch (const std::exception&)
 			{
-				non_fatal_error_handler(make_error_ptr("Converter initialization error"));
-				delete converter;
-				converter = NULL;
+				non_fatal_error_handler(errors::make_nested_ptr(std::current_exception(), make_error("Converter initialization error")));
+				converter.reset();
 			}
 			break;
 		}
@@ -525,8 +635,8 @@ void execCommand(data_stream& data_stream, UString& text, int& skip, rtf_parser_
 			if (state.font_table.find(arg) != state.font_table.end())
 			{
 				log_entry(arg, state.font_table[arg]);
-				if (converter != NULL)
-					converter->setFromCode(state.font_table[arg]);
+				if (converter)
+					converter->set_encoding(state.font_table[arg]);
 			}
 			else
 				state.last_font_ref_num = arg;
@@ -566,8 +676,6 @@ void execCommand(data_stream& data_stream, UString& text, int& skip, rtf_parser_
 	}
 }
 
-std::mutex converter_mutex;
-
 attributes::metadata extract_rtf_metadata(const data_source& data); // Forward declaration
 
 void parse_rtf_content(const data_source& data, const message_callbacks& emit_message)
@@ -575,35 +683,123 @@ void parse_rtf_content(const data_source& data, const message_callbacks& emit_me
 	log_scope(data);
 	UString text;
 	std::span<const std::byte> span = data.span();
-	auto stream = std::make_unique<buffer_stream>(reinterpret_cast<const char*>(span.data()), span.size());
-	TextConverter* converter = NULL;
-	try
+	rtf_reader stream{std::string_view{reinterpret_cast<const char*>(span.data()), span.size()}};
+	std::unique_ptr<code_page_converter> converter;
+	emit_message(document::document
+		{
+			.metadata = [&data]() { return extract_rtf_metadata(data); }
+		});
+	int ch;
+	rtf_parser_state state;
+	state.groups.push(rtf_group());
+	state.groups.top().uc = 1;
+	state.groups.top().destination = destination_type::text;
+	state.last_font_ref_num = 0;
+	int skip = 0;
+	while ((ch = stream.getc()) != EOF)
 	{
-		emit_message(document::document
-			{
-				.metadata = [&data]() { return extract_rtf_metadata(data); }
-			});
-		char ch;
-		rtf_parser_state state;
-		state.groups.push(rtf_group());
-		state.groups.top().uc = 1;
-		state.groups.top().destination = destination_type::text;
-		state.last_font_ref_num = 0;
-		int skip = 0;
-		while ((ch = stream->getc()) != EOF)
-		{
-			switch (ch)
+		switch (ch)
+		{
+			case '\\':
 			{
-				case '\\':
+				rtf_command cmd;
+				long int arg;
+				if (!parseCommand(stream, cmd, arg))
+					break;
+				UString fragment_text;
+				execCommand(stream, fragment_text, skip, state, cmd, arg, converter, [emit_message](std::exception_ptr e) { emit_message(std::move(e)); });
+				switch (state.groups.top().destination)
 				{
-					rtf_command cmd;
-					long int arg;
-					if (!parseCommand(*stream, cmd, arg))
+					case destination_type::annotation:
+						state.annotation_text += fragment_text;
+						break;
+					case destination_type::fldinst:
+						state.fldinst_text += fragment_text;
+						break;
+					case destination_type::fldrslt:
+						state.fldrslt_text += fragment_text;
 						break;
+					default:
+						text += fragment_text;
+				}
+				break;
+			}
+
+			case '{':
+				state.groups.push(state.groups.top());
+				//state.groups.top().destination = destination_type::text;
+				break;
+			case '}':
+			{
+				destination_type destination = state.groups.top().destination;
+				state.groups.pop();
+				if (destination == destination_type::annotation && state.groups.top().destination != destination_type::annotation)
+					emit_message(document::comment{.author = state.author_of_next_annotation, .time = convert::to<std::string>(state.annotation_time), .comment = ustring_to_string(state.annotation_text)});
+				else if (destination == destination_type::fldinst)
+				{
+				}
+				else if (destination == destination_type::fldrslt && state.groups.top().destination != destination_type::fldrslt)
+				{
+					std::string fldinst_text = ustring_to_string(state.fldinst_text);
+					if (fldinst_text.starts_with("HYPERLINK "))
+					{
+						std::string::size_type space_pos = fldinst_text.find(' ', 10);
+						if (space_pos == std::string::npos)
+							space_pos = fldinst_text.size();
+						std::string url = fldinst_text.substr(10, space_pos - 10);
+
+						// Trim leading whitespace.
+						url.erase(0, url.find_first_not_of(" \t\n\r\f\v"));
+
+						// Trim one leading quote.
+						if (url.starts_with('"')) {
+							url.erase(0, 1);
+						}
+
+						// Trim trailing whitespace and quotes.
+						if (auto pos = url.find_last_not_of(" \t\n\r\f\v\""); pos != std::string::npos) {
+							url.erase(pos + 1);
+						} else {
+							url.clear();
+						}
+
+						emit_message(document::link{.url = url});
+						emit_message(document::text{.text = ustring_to_string(state.fldrslt_text)});
+						emit_message(document::close_link{});
+					}
+				}
+				if (skip > state.groups.size() - 1)
+					skip = 0;
+				if (!text.isEmpty())
+				{
+					emit_message(document::text({.text = ustring_to_string(text)}));
+					text = "";
+				}
+				break;
+			}
+
+			default:
+				if (skip != 0)
+				{
+					// Skipped destinations (pictures, font tables, etc.) are consumed a run at a time.
+					stream.unGetc(ch);
+					stream.read_text_run();
+				}
+				else if ((ch != '\n' || state.groups.top().destination == destination_type::annotation) && ch != '\r')
+				{
+					// Plain text up to the next control character is converted at once instead of byte by byte.
+					stream.unGetc(ch);
+					std::string_view run = stream.read_text_run();
 					UString fragment_text;
+					if (converter)
+						fragment_text = converter->convert(run);
+					else
 					{
-						std::lock_guard<std::mutex> converter_mutex_lock(converter_mutex);
-						execCommand(*stream, fragment_text, skip, state, cmd, arg, converter, [emit_message](std::exception_ptr e) { emit_message(std::move(e)); });
+						std::vector<UChar> chars;
+						chars.reserve(run.size());
+						for (char c : run)
+							chars.push_back((UChar)c);
+						fragment_text = UString(chars.data(), chars.size());
 					}
 					switch (state.groups.top().destination)
 					{
@@ -619,100 +815,11 @@ void parse_rtf_content(const data_source& data, const message_callbacks& emit_me
 						default:
 							text += fragment_text;
 					}
-					break;
 				}
-
-				case '{':
-					state.groups.push(state.groups.top());
-					//state.groups.top().destination = destination_type::text;
-					break;
-				case '}':
-				{
-					destination_type destination = state.groups.top().destination;
-					state.groups.pop();
-					if (destination == destination_type::annotation && state.groups.top().destination != destination_type::annotation)
-						emit_message(document::comment{.author = state.author_of_next_annotation, .time = convert::to<std::string>(state.annotation_time), .comment = ustring_to_string(state.annotation_text)});
-					else if (destination == destination_type::fldinst)
-					{
-					}
-					else if (destination == destination_type::fldrslt && state.groups.top().destination != destination_type::fldrslt)
-					{
-						std::string fldinst_text = ustring_to_string(state.fldinst_text);
-						if (fldinst_text.starts_with("HYPERLINK "))
-						{
-							std::string::size_type space_pos = fldinst_text.find(' ', 10);
-							if (space_pos == std::string::npos)
-								space_pos = fldinst_text.size();
-							std::string url = fldinst_text.substr(10, space_pos - 10);
-
-							// Trim leading whitespace.
-							url.erase(0, url.find_first_not_of(" \t\n\r\f\v"));
-
-							// Trim one leading quote.
-							if (url.starts_with('"')) {
-								url.erase(0, 1);
-							}
-
-							// Trim trailing whitespace and quotes.
-							if (auto pos = url.find_last_not_of(" \t\n\r\f\v\""); pos != std::string::npos) {
-								url.erase(pos + 1);
-							} else {
-								url.clear();
-							}
-
-							emit_message(document::link{.url = url});
-							emit_message(document::text{.text = ustring_to_string(state.fldrslt_text)});
-							emit_message(document::close_link{});
-						}
-					}
-					if (skip > state.groups.size() - 1)
-						skip = 0;
-					if (!text.isEmpty())
-					{
-						emit_message(document::text({.text = ustring_to_string(text)}));
-						text = "";
-					}
-					break;
-				}
-
-				default:
-					if (skip == 0 && (ch != '\n' || state.groups.top().destination == destination_type::annotation) && ch != '\r')
-					{
-						UString fragment_text;
-						if (converter != NULL)
-							fragment_text = converter->convert((const char*)&ch, sizeof(ch));
-						else
-							fragment_text = UString((UChar)ch);
-						switch (state.groups.top().destination)
-						{
-							case destination_type::annotation:
-								state.annotation_text += fragment_text;
-								break;
-							case destination_type::fldinst:
-								state.fldinst_text += fragment_text;
-								break;
-							case destination_type::fldrslt:
-								state.fldrslt_text += fragment_text;
-								break;
-							default:
-								text += fragment_text;
-						}
-					}
-			}
-			throw_if (state.groups.size() == 0, "File is corrupted", errors::uninterpretable_data{}); //it will crash soon if groups.size() returns zero... better to check
 		}
-		if (converter != NULL)
-			delete converter;
-		converter = NULL;
-		emit_message(document::close_document{});
-	}
-	catch (std::bad_alloc& ba)
-	{
-		if (converter)
-			delete converter;
-		converter = NULL;
-		throw;
+		throw_if (state.groups.size() == 0, "File is corrupted", errors::uninterpretable_data{}); //it will crash soon if groups.size() returns zero... better to check
 	}
+	emit_message(document::close_document{});
 }
 
 std::optional<int> get_rtf_date_component(std::string_view s, std::string_view tag)
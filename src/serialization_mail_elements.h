@@ -41,7 +41,8 @@ struct serializer<mail::mail>
         return object{{
             {"subject", serialization::full(mail.subject)},
             {"date", serialization::full(mail.date)},
-            {"level", serialization::full(mail.level)}
+            {"level", serialization::full(mail.level)},
+            {"identifier", serialization::full(mail.identifier)}
         }};
     }
     value typed_summary(const mail::mail& mail) const { return decorate_with_typeid(full(mail), type_name::pretty<mail::mail>()); }
@@ -54,7 +55,8 @@ struct serializer<mail::folder>
     {
         return object{{
             {"name", serialization::full(folder.name)},
-            {"level", serialization::full(folder.level)}
+            {"level", serialization::full(folder.level)},
+            {"identifier", serialization::full(folder.identifier)}
         }};
     }
     value typed_summary(const mail::folder& folder) const { return decorate_with_typeid(full(folder), type_name::pretty<mail::folder>()); }
@@ -27,6 +27,7 @@ namespace docwire
  *  standard_filter::filterByAttachmentType({"jpg", "png"}) |
  *  plain_text_exporter{};
  * @endcode
+ * Mail parsers accept the same predicates as mail_filter, which skips rejected items before they are read.
  */
 class DOCWIRE_CORE_EXPORT standard_filter
 {
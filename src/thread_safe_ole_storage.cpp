@@ -11,27 +11,40 @@
 
 #include "thread_safe_ole_storage.h"
 
-#include "data_stream.h"
-#include <cmath>
+#include <algorithm>
+#include "binary_reader.h"
+#include <cstring>
+#include <fstream>
 #include "log_scope.h"
 #include "misc.h"
 #include <new>
-#include <memory>
-#include <cstdio>
-#include <cstring>
+#include <optional>
 #include "serialization_enum.h" // IWYU pragma: keep
 #include "thread_safe_ole_stream_reader.h"
 
 namespace docwire
 {
 
+namespace
+{
+
+constexpr uint32_t end_of_chain = 0xFFFFFFFE;
+constexpr uint32_t no_stream = 0xFFFFFFFF;
+constexpr size_t header_size = 512;
+constexpr size_t directory_entry_size = 128;
+constexpr size_t header_difat_entries = 109;
+
+} // anonymous namespace
+
 template<>
 struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 {
 	bool m_is_valid_ole;
 	std::string m_error;
 	std::string m_file_name;
-	data_stream* m_data_stream;
+	/// Contents of the file when storage is opened by name. Otherwise storage reads caller's buffer.
+	std::vector<std::byte> m_file_contents;
+	std::span<const std::byte> m_buffer;
 	uint16_t m_sector_size{0}, m_mini_sector_size{0};
 	uint32_t m_number_of_directories;
 	uint16_t m_header_version{0};
@@ -47,6 +60,8 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 	std::vector<uint32_t> m_fat_sectors_chain;
 	std::vector<uint32_t> m_sectors_chain;
 	std::vector<uint32_t> m_mini_sectors_chain;
+	/// Sectors of the root entry stream that holds all mini sectors, in order.
+	std::vector<uint32_t> m_mini_stream_sectors;
 
 	struct directory_entry
 	{
@@ -65,173 +80,173 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 		uint32_t m_child{0};
 		uint32_t m_start_sector_location{0};
 		uint64_t m_stream_size{0};
-		bool m_added{false};
 	};
-	std::shared_ptr<directory_entry> m_current_directory;
-	std::vector<std::shared_ptr<directory_entry>> m_directories;
-	std::vector<std::shared_ptr<directory_entry>> m_child_directories;
-	std::vector<std::shared_ptr<directory_entry>> m_inside_directories;
-	bool m_child_directories_loaded;
-	
+	/// All directory entries of the file, indexed by their ids.
+	std::vector<directory_entry> m_directories;
+	/// Ids of children of every directory entry, collected when the entry is listed for the first time.
+	std::vector<std::optional<std::vector<uint32_t>>> m_children;
+	uint32_t m_current_directory{0};
+	std::vector<uint32_t> m_inside_directories;
+
 	explicit pimpl_impl(const std::string &file_name)
 	{
 		m_file_name = file_name;
 		m_is_valid_ole = true;
-		m_data_stream = nullptr;
-		m_data_stream = new file_stream(file_name);
-		if (!m_data_stream->open())
+		std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+		if (!file)
 		{
 			m_is_valid_ole = false;
 			m_error = "File " + file_name + " cannot be open";
+			return;
 		}
-		m_child_directories_loaded = false;
-		parseHeader();
-		getFatArraySectorChain();
-		getFatSectorChain();
-		getMiniFatSectorChain();
-		getStoragesAndStreams();
+		m_file_contents.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(m_file_contents.data()), m_file_contents.size()))
+		{
+			m_is_valid_ole = false;
+			m_error = "File " + file_name + " cannot be read";
+			return;
+		}
+		m_buffer = m_file_contents;
+		load();
 	}
 
-	void init_from_buffer(std::span<const std::byte> buffer)
+	pimpl_impl(std::span<const std::byte> buffer)
 	{
 		m_file_name = "Memory buffer";
 		m_is_valid_ole = true;
-		m_data_stream = nullptr;
-		m_data_stream = new buffer_stream(reinterpret_cast<const char*>(buffer.data()), buffer.size());
-		if (!m_data_stream->open())
-		{
-			m_is_valid_ole = false;
-			m_error = "Memory buffer cannot be open";
-		}
-		m_child_directories_loaded = false;
+		m_buffer = buffer;
+		load();
+	}
+
+	void load()
+	{
 		parseHeader();
 		getFatArraySectorChain();
 		getFatSectorChain();
 		getMiniFatSectorChain();
 		getStoragesAndStreams();
+		getMiniStreamSectors();
 	}
 
-	pimpl_impl(std::span<const std::byte> buffer)
+	void fail(const std::string& error)
 	{
-		init_from_buffer(buffer);
+		m_is_valid_ole = false;
+		m_error = error;
 	}
 
-	~pimpl_impl()
+	/// Returns the contents of a regular sector or an empty span if the sector is outside of the file.
+	std::span<const std::byte> sector(uint32_t location) const
 	{
-		delete m_data_stream;
+		uint64_t offset = (uint64_t{location} + 1) * m_sector_size;
+		if (offset + m_sector_size > m_buffer.size())
+			return {};
+		return m_buffer.subspan(offset, m_sector_size);
 	}
 
-	void getStreamPositions(std::vector<uint32_t>& stream_positions, bool mini_stream, const std::shared_ptr<directory_entry>& dir_entry)
+	/// Reads sector locations stored in a FAT, mini FAT or DIFAT sector.
+	static void load_locations(std::span<const std::byte> data, uint32_t* locations, size_t count)
 	{
-		log_scope(mini_stream, dir_entry->m_name);
+		if constexpr (std::endian::native == std::endian::little)
+			memcpy(locations, data.data(), count * sizeof(uint32_t));
+		else
+			for (size_t i = 0; i < count; ++i)
+				locations[i] = binary::load_little_endian<uint32_t>(data.subspan(i * sizeof(uint32_t)));
+	}
+
+	void getStreamPositions(std::vector<uint32_t>& stream_positions, bool mini_stream, const directory_entry& dir_entry)
+	{
+		log_scope(mini_stream, dir_entry.m_name);
 		stream_positions.clear();
-		size_t mini_sectors_count = m_number_of_mini_fat_sectors * m_sector_size / 4;
-		size_t sectors_count = m_number_of_fat_sectors * m_sector_size / 4;
 		if (mini_stream)
 		{
-			uint32_t current_mini_sector_index = 0;
 			uint32_t mini_sectors_in_sector = m_sector_size / m_mini_sector_size;
-			uint32_t mini_sector_location = m_directories[0]->m_start_sector_location;
-			uint32_t mini_sector_position = dir_entry->m_start_sector_location;
-			while (mini_sector_position != 0xFFFFFFFE)
+			uint32_t mini_sector_position = dir_entry.m_start_sector_location;
+			while (mini_sector_position != end_of_chain)
 			{
 				uint32_t sector_index = mini_sector_position / mini_sectors_in_sector;
-				if (sector_index != current_mini_sector_index)
-				{
-					current_mini_sector_index = sector_index;
-					mini_sector_location = m_directories[0]->m_start_sector_location;
-					while (sector_index > 0)
-					{
-						if (mini_sector_location >= sectors_count)
-						{
-							stream_positions.clear();
-							return;
-						}
-						mini_sector_location = m_sectors_chain[mini_sector_location];
-						--sector_index;
-					}
-				}
-				uint32_t mini_sector_offset = mini_sector_position - current_mini_sector_index * mini_sectors_in_sector;
-				uint32_t position = (1 + mini_sector_location) * m_sector_size + mini_sector_offset * m_mini_sector_size;
-				stream_positions.push_back(position);
-				if (mini_sector_position >= mini_sectors_count)
+				if (sector_index >= m_mini_stream_sectors.size() || mini_sector_position >= m_mini_sectors_chain.size() ||
+					stream_positions.size() >= m_mini_sectors_chain.size())
 				{
 					stream_positions.clear();
 					return;
 				}
+				uint32_t mini_sector_offset = mini_sector_position - sector_index * mini_sectors_in_sector;
+				uint32_t position = (1 + m_mini_stream_sectors[sector_index]) * m_sector_size + mini_sector_offset * m_mini_sector_size;
+				stream_positions.push_back(position);
 				mini_sector_position = m_mini_sectors_chain[mini_sector_position];
 			}
 		}
 		else
 		{
-			uint32_t sector_location = dir_entry->m_start_sector_location;
-			while (sector_location != 0xFFFFFFFE)
+			uint32_t sector_location = dir_entry.m_start_sector_location;
+			while (sector_location != end_of_chain)
 			{
-				uint32_t position = (1 + sector_location) * m_sector_size;
-				stream_positions.push_back(position);
-				if (sector_location >= sectors_count)
+				if (sector_location >= m_sectors_chain.size() || stream_positions.size() >= m_sectors_chain.size())
 				{
 					stream_positions.clear();
 					return;
 				}
+				stream_positions.push_back((1 + sector_location) * m_sector_size);
 				sector_location = m_sectors_chain[sector_location];
 			}
 		}
 	}
 
-	bool getCurrentDirectoryChilds()
+	void getMiniStreamSectors()
 	{
 		log_scope();
-		for (auto & m_child_directory : m_child_directories)
-			m_child_directory->m_added = false;
-		if (m_current_directory->m_child == 0xFFFFFFFF)
-			return true;
-		if (m_current_directory->m_child >= m_directories.size())
+		if (!m_is_valid_ole)
+			return;
+		uint32_t sector_location = m_directories[0].m_start_sector_location;
+		while (sector_location < m_sectors_chain.size() && m_mini_stream_sectors.size() < m_sectors_chain.size())
 		{
-			m_error = "Index of directory entry is outside the vector";
-			return false;
+			m_mini_stream_sectors.push_back(sector_location);
+			sector_location = m_sectors_chain[sector_location];
 		}
-		m_child_directories.push_back(m_directories[m_current_directory->m_child]);
-		int index_start = 0;
-		int index_end = 0;
-		std::shared_ptr<directory_entry> current_dir;
-		std::shared_ptr<directory_entry> added_dir;
-		while (index_start != index_end + 1)
+	}
+
+	const std::vector<uint32_t>* getCurrentDirectoryChilds()
+	{
+		log_scope();
+		std::optional<std::vector<uint32_t>>& children = m_children[m_current_directory];
+		if (children)
+			return &*children;
+		std::vector<uint32_t> child_directories;
+		uint32_t child = m_directories[m_current_directory].m_child;
+		if (child != no_stream)
 		{
-			current_dir = m_child_directories[index_start];
-			if (current_dir->m_left_sibling != 0xFFFFFFFF)
+			if (child >= m_directories.size())
 			{
-				if (current_dir->m_left_sibling >= m_directories.size())
-				{
-					m_error = "Index of directory entry is outside the vector";
-					return false;
-				}
-				added_dir = m_directories[current_dir->m_left_sibling];
-				if (!added_dir->m_added)
-				{
-					m_child_directories.push_back(added_dir);
-					++index_end;
-					added_dir->m_added = true;
-				}
+				m_error = "Index of directory entry is outside the vector";
+				return nullptr;
 			}
-			if (current_dir->m_right_sibling != 0xFFFFFFFF)
+			// Siblings form a tree. Entries are listed in breadth-first order, each of them once.
+			std::vector<bool> added(m_directories.size(), false);
+			child_directories.push_back(child);
+			added[child] = true;
+			for (size_t index = 0; index < child_directories.size(); ++index)
 			{
-				if (current_dir->m_right_sibling >= m_directories.size())
+				const directory_entry& current_dir = m_directories[child_directories[index]];
+				for (uint32_t sibling : { current_dir.m_left_sibling, current_dir.m_right_sibling })
 				{
-					m_error = "Index of directory entry is outside the vector";
-					return false;
-				}
-				added_dir = m_directories[current_dir->m_right_sibling];
-				if (!added_dir->m_added)
-				{
-					m_child_directories.push_back(added_dir);
-					++index_end;
-					added_dir->m_added = true;
+					if (sibling == no_stream)
+						continue;
+					if (sibling >= m_directories.size())
+					{
+						m_error = "Index of directory entry is outside the vector";
+						return nullptr;
+					}
+					if (!added[sibling])
+					{
+						child_directories.push_back(sibling);
+						added[sibling] = true;
+					}
 				}
 			}
-			++index_start;
 		}
-		return true;
+		children = std::move(child_directories);
+		return &*children;
 	}
 
 	void getStoragesAndStreams()
@@ -239,134 +254,74 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 		log_scope();
 		if (!m_is_valid_ole)
 			return;
-		size_t records_count = m_sector_size / 4;
-		size_t directory_count_per_sector = m_sector_size / 128;
-		std::shared_ptr<directory_entry> directory;
+		size_t directory_count_per_sector = m_sector_size / directory_entry_size;
 		uint32_t directory_location = m_first_sector_directory_location;
-		while (directory_location != 0xFFFFFFFE)
+		size_t sectors_read = 0;
+		while (directory_location != end_of_chain)
 		{
-			if (!m_data_stream->seek((1 + directory_location) * m_sector_size, SEEK_SET))
+			std::span<const std::byte> directory_sector = sector(directory_location);
+			if (directory_sector.empty())
 			{
-				m_error = "Position of sector is outside of the file!";
-				m_is_valid_ole = false;
+				fail("Position of sector is outside of the file!");
 				return;
 			}
 			for (size_t i = 0; i < directory_count_per_sector; ++i)
 			{
-				try
+				std::span<const std::byte> entry = directory_sector.subspan(i * directory_entry_size, directory_entry_size);
+				directory_entry directory;
+				for (int j = 0; j < 32; ++j)
 				{
-					directory.reset(new directory_entry());
-					directory->m_added = false;
-					uint16_t unichars[32];
-					if (!m_data_stream->read(unichars, sizeof(uint16_t), 32))
-					{
-						m_error = "Error in reading directory name";
-						m_is_valid_ole = false;
-						return;
-					}
-					for (int j = 0; j < 32; ++j)
+					unsigned int ch = binary::load_little_endian<uint16_t>(entry.subspan(j * 2));
+					if (ch == 0)
+						break;
+					if (utf16_unichar_has_4_bytes(ch))
 					{
-						unsigned int ch = unichars[j];
-						if (ch == 0)
+						if (++j < 32)
+							ch = (ch << 16) | binary::load_little_endian<uint16_t>(entry.subspan(j * 2));
+						else
 							break;
-						if (utf16_unichar_has_4_bytes(ch))
-						{
-							if (++j < 32)
-								ch = (ch << 16) | unichars[j];
-							else
-								break;
-						}
-						directory->m_name += unichar_to_utf8(ch);
-					}
-					if (!skipBytes(2))
-						return;
-					uint8_t object_type;
-					if (!m_data_stream->read(&object_type, sizeof(uint8_t), 1))
-					{
-						m_error = "Error in reading type of object";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (object_type != 0x00 && object_type != 0x01 && object_type != 0x02 && object_type != 0x05)
-					{
-						m_error = "Invalid type of object";
-						m_is_valid_ole = false;
-						return;
-					}
-					directory->m_object_type = (directory_entry::object_type)object_type;
-					uint8_t color_flag;
-					if (!m_data_stream->read(&color_flag, sizeof(uint8_t), 1))
-					{
-						m_error = "Error in reading color flag";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (color_flag != 0x00 && color_flag != 0x01)
-					{
-						m_error = "Invalid color flag";
-						m_is_valid_ole = false;
-						return;
-					}
-					directory->m_color_flag = color_flag;
-					if (!m_data_stream->read(&directory->m_left_sibling, sizeof(uint32_t), 1))
-					{
-						m_error = "Error in reading left sibling";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (!m_data_stream->read(&directory->m_right_sibling, sizeof(uint32_t), 1))
-					{
-						m_error = "Error in reading directory right sibling";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (!m_data_stream->read(&directory->m_child, sizeof(uint32_t), 1))
-					{
-						m_error = "Error in reading child";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (!skipBytes(36))
-						return;
-					if (!m_data_stream->read(&directory->m_start_sector_location, sizeof(uint32_t), 1))
-					{
-						m_error = "Error in reading sector location";
-						m_is_valid_ole = false;
-						return;
 					}
-					if (!m_data_stream->read(&directory->m_stream_size, sizeof(uint64_t), 1))
-					{
-						m_error = "Error in reading sector size";
-						m_is_valid_ole = false;
-						return;
-					}
-					if (m_header_version == 0x03)
-					{
-						directory->m_stream_size = directory->m_stream_size & 0x00000000FFFFFFFF;
-					}
-					m_directories.push_back(directory);
+					directory.m_name += unichar_to_utf8(ch);
+				}
+				uint8_t object_type = static_cast<uint8_t>(entry[66]);
+				if (object_type != 0x00 && object_type != 0x01 && object_type != 0x02 && object_type != 0x05)
+				{
+					fail("Invalid type of object");
+					return;
+				}
+				directory.m_object_type = (directory_entry::object_type)object_type;
+				uint8_t color_flag = static_cast<uint8_t>(entry[67]);
+				if (color_flag != 0x00 && color_flag != 0x01)
+				{
+					fail("Invalid color flag");
+					return;
 				}
-				catch (std::bad_alloc& ba)
+				directory.m_color_flag = color_flag;
+				directory.m_left_sibling = binary::load_little_endian<uint32_t>(entry.subspan(68));
+				directory.m_right_sibling = binary::load_little_endian<uint32_t>(entry.subspan(72));
+				directory.m_child = binary::load_little_endian<uint32_t>(entry.subspan(76));
+				directory.m_start_sector_location = binary::load_little_endian<uint32_t>(entry.subspan(116));
+				directory.m_stream_size = binary::load_little_endian<uint64_t>(entry.subspan(120));
+				if (m_header_version == 0x03)
 				{
-					throw;
+					directory.m_stream_size = directory.m_stream_size & 0x00000000FFFFFFFF;
 				}
+				m_directories.push_back(std::move(directory));
 			}
-			if (directory_location >= m_number_of_fat_sectors * records_count)
+			if (directory_location >= m_sectors_chain.size() || ++sectors_read > m_sectors_chain.size())
 			{
-				m_error = "Directory location is outside of the sector chain";
-				m_is_valid_ole = false;
+				fail("Directory location is outside of the sector chain");
 				return;
 			}
 			directory_location = m_sectors_chain[directory_location];
 		}
 		if (m_directories.empty())
 		{
-			m_is_valid_ole = false;
-			m_error = "Root directory does not exist";
+			fail("Root directory does not exist");
 			return;
 		}
-		m_current_directory = m_directories[0];
-		m_data_stream->close();
+		m_children.resize(m_directories.size());
+		m_current_directory = 0;
 	}
 
 	void getMiniFatSectorChain()
@@ -375,30 +330,29 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 		if (!m_is_valid_ole)
 			return;
 		size_t records_count = m_sector_size / 4;
+		if (m_number_of_mini_fat_sectors > m_buffer.size() / m_sector_size)
+		{
+			fail("Number of mini FAT sectors exceeds size of the file");
+			return;
+		}
 		m_mini_sectors_chain.resize(m_number_of_mini_fat_sectors * records_count);
-		size_t mini_sector_location = m_first_mini_fat_sector_location;
+		uint32_t mini_sector_location = m_first_mini_fat_sector_location;
 		for (size_t i = 0; i < m_number_of_mini_fat_sectors; ++i)
 		{
-			if (!m_data_stream->seek((1 + mini_sector_location) * m_sector_size, SEEK_SET))
+			std::span<const std::byte> mini_fat_sector = sector(mini_sector_location);
+			if (mini_fat_sector.empty())
 			{
-				m_error = "Position of sector is outside of the file!";
-				m_is_valid_ole = false;
+				fail("Position of sector is outside of the file!");
 				return;
 			}
-			if (!m_data_stream->read(&m_mini_sectors_chain[i * records_count], sizeof(uint32_t), records_count))
+			load_locations(mini_fat_sector, &m_mini_sectors_chain[i * records_count], records_count);
+			if (mini_sector_location >= m_sectors_chain.size())
 			{
-				m_error = "Error in reading sector chain";
-				m_is_valid_ole = false;
-				return;
-			}
-			if (mini_sector_location >= m_number_of_fat_sectors * records_count)
-			{
-				m_error = "Mini sector location is outside of the sector chain";
-				m_is_valid_ole = false;
+				fail("Mini sector location is outside of the sector chain");
 				return;
 			}
 			mini_sector_location = m_sectors_chain[mini_sector_location];
-			if (mini_sector_location == 0xFFFFFFFE)
+			if (mini_sector_location == end_of_chain)
 				break;
 		}
 	}
@@ -412,18 +366,13 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 		m_sectors_chain.resize(m_number_of_fat_sectors * records_count);
 		for (size_t i = 0; i < m_number_of_fat_sectors; ++i)
 		{
-			if (!m_data_stream->seek((1 + m_fat_sectors_chain[i]) * m_sector_size, SEEK_SET))
+			std::span<const std::byte> fat_sector = sector(m_fat_sectors_chain[i]);
+			if (fat_sector.empty())
 			{
-				m_error = "Position of sector is outside of the file!";
-				m_is_valid_ole = false;
-				return;
-			}
-			if (!m_data_stream->read(&m_sectors_chain[i * records_count], sizeof(uint32_t), records_count))
-			{
-				m_error = "Error in reading sector chain";
-				m_is_valid_ole = false;
+				fail("Position of sector is outside of the file!");
 				return;
 			}
+			load_locations(fat_sector, &m_sectors_chain[i * records_count], records_count);
 		}
 	}
 
@@ -432,123 +381,69 @@ struct pimpl_impl<thread_safe_ole_storage> : pimpl_impl_base
 		log_scope();
 		if (!m_is_valid_ole)
 			return;
-		uint32_t records_count = m_sector_size / 4 - 1;
-		m_fat_sectors_chain.resize(m_number_of_fat_sectors);
-		uint32_t remaining_fat_sector_chain_count = m_number_of_fat_sectors;
-		for (int i = 0; i < 109; ++i)
+		if (m_number_of_fat_sectors > m_buffer.size() / m_sector_size)
 		{
-			if (remaining_fat_sector_chain_count == 0)
-				break;
-			if (!getUint32(m_fat_sectors_chain[i]))
-				return;
-			--remaining_fat_sector_chain_count;
+			fail("Number of FAT sectors exceeds size of the file");
+			return;
 		}
+		uint32_t records_count = m_sector_size / 4 - 1;
+		m_fat_sectors_chain.resize(m_number_of_fat_sectors);
+		size_t loaded = std::min<size_t>(m_number_of_fat_sectors, header_difat_entries);
+		load_locations(m_buffer.subspan(header_size - header_difat_entries * 4), m_fat_sectors_chain.data(), loaded);
 		uint32_t difat_sector_location = m_first_difat_sector_location;
-		for (uint32_t i = 0; i < m_number_of_difat_sectors; ++i)
+		for (uint32_t i = 0; i < m_number_of_difat_sectors && loaded < m_number_of_fat_sectors; ++i)
 		{
-			if (!m_data_stream->seek((1 + difat_sector_location) * m_sector_size, SEEK_SET))
+			std::span<const std::byte> difat_sector = sector(difat_sector_location);
+			if (difat_sector.empty())
 			{
-				m_error = "Position of sector is outside of the file!";
-				m_is_valid_ole = false;
+				fail("Position of sector is outside of the file!");
 				return;
 			}
-			for (uint32_t j = 0; j < records_count; ++j)
-			{
-				if (remaining_fat_sector_chain_count == 0)
-					break;
-				if (!getUint32(m_fat_sectors_chain[109 + i * records_count + j]))
-					return;
-				--remaining_fat_sector_chain_count;
-			}
-			if (!getUint32(difat_sector_location))
-				return;
-			if (difat_sector_location == 0xFFFFFFFE)
+			size_t count = std::min<size_t>(m_number_of_fat_sectors - loaded, records_count);
+			load_locations(difat_sector, &m_fat_sectors_chain[loaded], count);
+			loaded += count;
+			difat_sector_location = binary::load_little_endian<uint32_t>(difat_sector.subspan(records_count * 4));
+			if (difat_sector_location == end_of_chain)
 				break;
 		}
 	}
 
-	bool skipBytes(int bytes_to_skip)
-	{
-		log_scope(bytes_to_skip);
-		if (!m_data_stream->seek(bytes_to_skip, SEEK_CUR))
-		{
-			m_is_valid_ole = false;
-			m_error = "Cant seek";
-			return false;
-		}
-		return  true;
-	}
-
-	bool getUint16(uint16_t& data)
-	{
-		log_scope();
-		if (!m_data_stream->read(&data, sizeof(uint16_t), 1))
-		{
-			m_is_valid_ole = false;
-			m_error = "Error in reading 16-bit number";
-			return false;
-		}
-		return true;
-	}
-
-	bool getUint32(uint32_t& data)
-	{
-		log_scope();
-		if (!m_data_stream->read(&data, sizeof(uint32_t), 1))
-		{
-			m_is_valid_ole = false;
-			m_error = "Error in reading 32-bit number";
-			return false;
-		}
-		return true;
-	}
-
 	void parseHeader()
 	{
 		log_scope();
-		uint8_t ole_header[] = {0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1};
-		uint8_t readed_ole_header[8];
+		const uint8_t ole_header[] = {0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1};
 		if (!m_is_valid_ole)
 			return;
-		if (!m_data_stream->read(readed_ole_header, sizeof(uint8_t), 8) ||
-				memcmp(readed_ole_header, ole_header, 8) != 0)
+		if (m_buffer.size() < sizeof(ole_header) || memcmp(m_buffer.data(), ole_header, sizeof(ole_header)) != 0)
 		{
-			m_is_valid_ole = false;
-			m_error = "Header is invalid: no OLE signature";
+			fail("Header is invalid: no OLE signature");
 			return;
 		}
-		if (!skipBytes(18))
-			return;
-		if (!getUint16(m_header_version))
-			return;
-		if (!getUint16(m_byte_order))
-			return;
-		if (!getUint16(m_sector_size))
-			return;
-		m_sector_size = (uint16_t)pow(2, m_sector_size);
-		if (!getUint16(m_mini_sector_size))
-			return;
-		m_mini_sector_size = (uint16_t)pow(2, m_mini_sector_size);
-		if (!skipBytes(6))
-			return;
-		if (!getUint32(m_number_of_directories))
-			return;
-		if (!getUint32(m_number_of_fat_sectors))
-			return;
-		if (!getUint32(m_first_sector_directory_location))
-			return;
-		if (!skipBytes(4))
-			return;
-		if (!getUint32(m_mini_stream_cut_off))
-			return;
-		if (!getUint32(m_first_mini_fat_sector_location))
-			return;
-		if (!getUint32(m_number_of_mini_fat_sectors))
-			return;
-		if (!getUint32(m_first_difat_sector_location))
+		if (m_buffer.size() < header_size)
+		{
+			fail("Header is truncated");
 			return;
-		if (!getUint32(m_number_of_difat_sectors))
+		}
+		std::span<const std::byte> header = m_buffer.first(header_size);
+		m_header_version = binary::load_little_endian<uint16_t>(header.subspan(26));
+		m_byte_order = binary::load_little_endian<uint16_t>(header.subspan(28));
+		uint16_t sector_shift = binary::load_little_endian<uint16_t>(header.subspan(30));
+		uint16_t mini_sector_shift = binary::load_little_endian<uint16_t>(header.subspan(32));
+		if (sector_shift < 7 || sector_shift > 15 || mini_sector_shift > sector_shift)
+		{
+			fail("Invalid sector size");
 			return;
+		}
+		m_sector_size = uint16_t(1) << sector_shift;
+		m_mini_sector_size = uint16_t(1) << mini_sector_shift;
+		m_number_of_directories = binary::load_little_endian<uint32_t>(header.subspan(40));
+		m_number_of_fat_sectors = binary::load_little_endian<uint32_t>(header.subspan(44));
+		m_first_sector_directory_location = binary::load_little_endian<uint32_t>(header.subspan(48));
+		m_mini_stream_cut_off = binary::load_little_endian<uint32_t>(header.subspan(56));
+		m_first_mini_fat_sector_location = binary::load_little_endian<uint32_t>(header.subspan(60));
+		m_number_of_mini_fat_sectors = binary::load_little_endian<uint32_t>(header.subspan(64));
+		m_first_difat_sector_location = binary::load_little_endian<uint32_t>(header.subspan(68));
+		m_number_of_difat_sectors = binary::load_little_endian<uint32_t>(header.subspan(72));
 	}
 };
 
@@ -596,17 +491,14 @@ bool thread_safe_ole_storage::getStreamsAndStoragesList(std::vector<std::string>
 {
 	log_scope();
 	components.clear();
-	if (!impl().m_is_valid_ole || impl().m_current_directory == nullptr)
+	if (!impl().m_is_valid_ole)
 		return false;
-	if (!impl().m_child_directories_loaded)
-	{
-		if (!impl().getCurrentDirectoryChilds())
-			return false;
-		impl().m_child_directories_loaded = true;
-	}
-	for (auto & m_child_directory : impl().m_child_directories)
+	const std::vector<uint32_t>* children = impl().getCurrentDirectoryChilds();
+	if (children == nullptr)
+		return false;
+	for (uint32_t child : *children)
 	{
-		components.push_back(m_child_directory->m_name);
+		components.push_back(impl().m_directories[child].m_name);
 	}
 	return true;
 }
@@ -614,29 +506,22 @@ bool thread_safe_ole_storage::getStreamsAndStoragesList(std::vector<std::string>
 bool thread_safe_ole_storage::enterDirectory(const std::string& directory_path)
 {
 	log_scope(directory_path);
-	if (!impl().m_is_valid_ole || impl().m_current_directory == nullptr)
+	if (!impl().m_is_valid_ole)
 		return false;
-	if (!impl().m_child_directories_loaded)
-	{
-		if (!impl().getCurrentDirectoryChilds())
-			return false;
-		impl().m_child_directories_loaded = true;
-	}
-	for (size_t i = 0; i < impl().m_child_directories.size(); ++i)
+	const std::vector<uint32_t>* children = impl().getCurrentDirectoryChilds();
+	if (children == nullptr)
+		return false;
+	for (uint32_t child : *children)
 	{
-		if (impl().m_child_directories[i]->m_name == directory_path)
+		if (impl().m_directories[child].m_name == directory_path)
 		{
-			if (impl().m_child_directories[i]->m_object_type != pimpl_impl<thread_safe_ole_storage>::directory_entry::storage)
+			if (impl().m_directories[child].m_object_type != pimpl_impl<thread_safe_ole_storage>::directory_entry::storage)
 			{
 				impl().m_error = "Specified object is not directory";
 				return false;
 			}
 			impl().m_inside_directories.push_back(impl().m_current_directory);
-			impl().m_current_directory = impl().m_child_directories[i];
-			impl().m_child_directories_loaded = false;
-			for (auto & m_child_directory : impl().m_child_directories)
-				m_child_directory->m_added = false;
-			impl().m_child_directories.clear();
+			impl().m_current_directory = child;
 			return true;
 		}
 	}
@@ -647,7 +532,7 @@ bool thread_safe_ole_storage::enterDirectory(const std::string& directory_path)
 bool thread_safe_ole_storage::leaveDirectory()
 {
 	log_scope();
-	if (!impl().m_is_valid_ole || impl().m_current_directory == nullptr)
+	if (!impl().m_is_valid_ole)
 		return false;
 	if (impl().m_inside_directories.empty())
 	{
@@ -656,69 +541,47 @@ bool thread_safe_ole_storage::leaveDirectory()
 	}
 	impl().m_current_directory = impl().m_inside_directories.back();
 	impl().m_inside_directories.pop_back();
-	impl().m_child_directories_loaded = false;
-	for (auto & m_child_directory : impl().m_child_directories)
-		m_child_directory->m_added = false;
-	impl().m_child_directories.clear();
 	return true;
 }
 
 OLEStreamReader *thread_safe_ole_storage::createStreamReader(const std::string& stream_path)
 {
 	log_scope(stream_path);
-	if (!impl().m_is_valid_ole || impl().m_current_directory == nullptr) {
-        return nullptr;
-    }
-	if (!impl().m_child_directories_loaded)
-	{
-		if (!impl().getCurrentDirectoryChilds()) {
-            return nullptr;
-        }
-		impl().m_child_directories_loaded = true;
-	}
-	for (auto & m_child_directory : impl().m_child_directories)
+	if (!impl().m_is_valid_ole)
+		return nullptr;
+	const std::vector<uint32_t>* children = impl().getCurrentDirectoryChilds();
+	if (children == nullptr)
+		return nullptr;
+	for (uint32_t child : *children)
 	{
-		if (m_child_directory->m_name == stream_path)
+		const pimpl_impl<thread_safe_ole_storage>::directory_entry& entry = impl().m_directories[child];
+		if (entry.m_name == stream_path)
 		{
-			if (m_child_directory->m_object_type != pimpl_impl<thread_safe_ole_storage>::directory_entry::stream)
+			if (entry.m_object_type != pimpl_impl<thread_safe_ole_storage>::directory_entry::stream)
 			{
 				impl().m_error = "Specified object is not a stream";
 				return nullptr;
 			}
 			thread_safe_ole_stream_reader::stream stream;
-			thread_safe_ole_stream_reader* ole_stream_reader = nullptr;
-			stream.m_data_stream = nullptr;
-			try
+			stream.m_buffer = impl().m_buffer;
+			stream.m_size = entry.m_stream_size;
+			if (stream.m_size < impl().m_mini_stream_cut_off)
 			{
-				stream.m_data_stream = impl().m_data_stream->clone();
-				stream.m_size = m_child_directory->m_stream_size;
-				if (stream.m_size < impl().m_mini_stream_cut_off)
-				{
-					stream.m_sector_size = impl().m_mini_sector_size;
-					impl().getStreamPositions(stream.m_file_positions, true, m_child_directory);
-				}
-				else
-				{
-					stream.m_sector_size = impl().m_sector_size;
-					impl().getStreamPositions(stream.m_file_positions, false, m_child_directory);
-				}
-				ole_stream_reader = new thread_safe_ole_stream_reader(this, stream);
-				if (!ole_stream_reader->isValid())
-				{
-					impl().m_error = ole_stream_reader->getLastError();
-					delete ole_stream_reader;
-					return nullptr;
-				}
-				return ole_stream_reader;
+				stream.m_sector_size = impl().m_mini_sector_size;
+				impl().getStreamPositions(stream.m_file_positions, true, entry);
 			}
-			catch (std::bad_alloc& ba)
+			else
 			{
-
-					delete stream.m_data_stream;
-
-					delete ole_stream_reader;
-				throw;
+				stream.m_sector_size = impl().m_sector_size;
+				impl().getStreamPositions(stream.m_file_positions, false, entry);
+			}
+			auto ole_stream_reader = std::make_unique<thread_safe_ole_stream_reader>(this, stream);
+			if (!ole_stream_reader->isValid())
+			{
+				impl().m_error = ole_stream_reader->getLastError();
+				return nullptr;
 			}
+			return ole_stream_reader.release();
 		}
 	}
 	impl().m_error = "Specified stream does not exist";
@@ -728,24 +591,17 @@ OLEStreamReader *thread_safe_ole_storage::createStreamReader(const std::string&
 bool thread_safe_ole_storage::readDirectFromBuffer(unsigned char* buffer, int size, int offset)
 {
 	log_scope(size, offset);
-	if (!impl().m_data_stream->open())
-	{
-		impl().m_error = "Cannot open file " + impl().m_file_name;
-		return false;
-	}
-	if (!impl().m_data_stream->seek(offset, SEEK_SET))
+	if (offset < 0 || size < 0 || static_cast<size_t>(offset) > impl().m_buffer.size())
 	{
 		impl().m_error = "Cant seek to the selected position";
-		impl().m_data_stream->close();
 		return false;
 	}
-	if (!impl().m_data_stream->read(buffer, sizeof(unsigned char), size))
+	if (static_cast<size_t>(size) > impl().m_buffer.size() - offset)
 	{
 		impl().m_error = "Cant read from file";
-		impl().m_data_stream->close();
 		return false;
 	}
-	impl().m_data_stream->close();
+	memcpy(buffer, impl().m_buffer.data() + offset, size);
 	return true;
 }
 
@@ -11,7 +11,9 @@
 
 #include "thread_safe_ole_stream_reader.h"
 
-#include "data_stream.h"
+#include <algorithm>
+#include "binary_reader.h"
+#include <cstring>
 
 namespace docwire
 {
@@ -21,52 +23,139 @@ using namespace wvWare;
 template<>
 struct pimpl_impl<thread_safe_ole_stream_reader> : pimpl_impl_base
 {
-	data_stream* m_data_stream{};
+	/// Adjacent sectors of the stream, merged into one range of the file.
+	struct extent
+	{
+		uint64_t m_stream_offset;
+		uint64_t m_file_offset;
+		uint64_t m_length;
+	};
+
+	std::span<const std::byte> m_buffer;
 	uint64_t m_size{0};
 	uint64_t m_position{0};
-	uint64_t m_chunk_position{0};
-	std::vector<uint64_t> m_sector_positions;
-	uint32_t m_sector_size{0};
-	uint32_t m_current_sector{0};
+	std::vector<extent> m_extents;
+	mutable size_t m_current_extent{0};
 	std::string m_error;
 	bool m_valid{false};
+
+	void build_extents(const std::vector<uint32_t>& sector_positions, uint32_t sector_size)
+	{
+		for (uint32_t position : sector_positions)
+		{
+			if (!m_extents.empty() && m_extents.back().m_file_offset + m_extents.back().m_length == position)
+				m_extents.back().m_length += sector_size;
+			else
+			{
+				uint64_t stream_offset = m_extents.empty() ? 0 : m_extents.back().m_stream_offset + m_extents.back().m_length;
+				m_extents.push_back(extent{stream_offset, position, sector_size});
+			}
+		}
+	}
+
+	const extent* find_extent(uint64_t position) const
+	{
+		if (m_current_extent < m_extents.size())
+		{
+			const extent& current = m_extents[m_current_extent];
+			if (position >= current.m_stream_offset && position < current.m_stream_offset + current.m_length)
+				return &current;
+		}
+		auto it = std::upper_bound(m_extents.begin(), m_extents.end(), position,
+			[](uint64_t position, const extent& e) { return position < e.m_stream_offset; });
+		if (it == m_extents.begin())
+			return nullptr;
+		--it;
+		if (position >= it->m_stream_offset + it->m_length)
+			return nullptr;
+		m_current_extent = it - m_extents.begin();
+		return &*it;
+	}
+
+	std::span<const std::byte> contiguous_data() const
+	{
+		if (!m_valid || m_position >= m_size)
+			return {};
+		const extent* e = find_extent(m_position);
+		if (e == nullptr)
+			return {};
+		uint64_t offset_in_extent = m_position - e->m_stream_offset;
+		uint64_t file_offset = e->m_file_offset + offset_in_extent;
+		if (file_offset >= m_buffer.size())
+			return {};
+		uint64_t length = std::min({e->m_length - offset_in_extent, m_size - m_position, m_buffer.size() - file_offset});
+		return m_buffer.subspan(file_offset, length);
+	}
+
+	bool read(U8* buf, size_t length)
+	{
+		if (!m_valid)
+			return false;
+		uint64_t to_read = length;
+		if (to_read > m_size - m_position)
+		{
+			m_error = "Requested size to read is too big";
+			to_read = m_size - m_position;
+		}
+		while (to_read > 0)
+		{
+			std::span<const std::byte> data = contiguous_data();
+			if (data.empty())
+			{
+				m_valid = false;
+				m_error = "Read past EOF";
+				return false;
+			}
+			size_t chunk = std::min<uint64_t>(to_read, data.size());
+			memcpy(buf, data.data(), chunk);
+			buf += chunk;
+			m_position += chunk;
+			to_read -= chunk;
+		}
+		return true;
+	}
+
+	/// Integers that do not cross a sector boundary are loaded directly from the file.
+	template<typename T>
+	bool read_integer(T& value)
+	{
+		std::span<const std::byte> data = contiguous_data();
+		if (data.size() >= sizeof(T))
+		{
+			value = binary::load_little_endian<T>(data);
+			m_position += sizeof(T);
+			return true;
+		}
+		std::byte bytes[sizeof(T)]{};
+		bool result = read(reinterpret_cast<U8*>(bytes), sizeof(T));
+		value = binary::load_little_endian<T>(bytes);
+		return result;
+	}
 };
 
 thread_safe_ole_stream_reader::thread_safe_ole_stream_reader(thread_safe_ole_storage *storage, stream &stream)
 	: OLEStreamReader((wvWare::OLEStorage*)storage)
 {
-	impl().m_data_stream = stream.m_data_stream;
+	impl().m_buffer = stream.m_buffer;
 	impl().m_position = 0;
-	impl().m_chunk_position = 0;
 	impl().m_size = stream.m_size;
-	impl().m_sector_positions.assign(stream.m_file_positions.begin(), stream.m_file_positions.end());
-	impl().m_sector_size = stream.m_sector_size;
 	impl().m_valid = true;
-	impl().m_current_sector = 0;
-	if (!impl().m_data_stream->open())
-	{
-		impl().m_error = "Empty file";
-		impl().m_valid = false;
-		return;
-	}
-	if (impl().m_sector_positions.empty())
+	if (stream.m_file_positions.empty())
 	{
 		impl().m_error = "Stream is empty";
 		impl().m_valid = false;
 		return;
 	}
-	if (!impl().m_data_stream->seek(impl().m_sector_positions[0], SEEK_SET))
+	if (stream.m_file_positions[0] > impl().m_buffer.size())
 	{
 		impl().m_error = "Cant seek to the first sector";
 		impl().m_valid = false;
+		return;
 	}
+	impl().build_extents(stream.m_file_positions, stream.m_sector_size);
 }
 
-thread_safe_ole_stream_reader::~thread_safe_ole_stream_reader()
-{
-	impl().m_data_stream->close();
-	delete impl().m_data_stream;
-}
+thread_safe_ole_stream_reader::~thread_safe_ole_stream_reader() = default;
 
 std::string thread_safe_ole_stream_reader::getLastError() const
 {
@@ -90,61 +179,7 @@ size_t thread_safe_ole_stream_reader::size() const
 
 bool thread_safe_ole_stream_reader::read(U8* buf, size_t length)
 {
-	if (!impl().m_valid)
-		return false;
-	uint64_t to_read = length;
-	uint64_t read_pos = 0;
-	if (to_read > impl().m_size - impl().m_position)
-	{
-		impl().m_error = "Requested size to read is too big";
-		to_read = impl().m_size - impl().m_position;
-	}
-	while (to_read > 0)
-	{
-		if (to_read <= impl().m_sector_size - impl().m_chunk_position)
-		{
-			if (!impl().m_data_stream->read(buf + read_pos, sizeof(uint8_t), to_read))
-			{
-				impl().m_valid = false;
-				impl().m_error = "Read past EOF";
-				return false;
-			}
-			impl().m_position += to_read;
-			impl().m_chunk_position += to_read;
-			to_read = 0;
-		}
-		else
-		{
-			uint32_t rest = impl().m_sector_size - impl().m_chunk_position;
-			if (rest > 0)
-			{
-				if (!impl().m_data_stream->read(buf + read_pos, sizeof(uint8_t), rest))
-				{
-					impl().m_valid = false;
-					impl().m_error = "Read past EOF";
-					return false;
-				}
-				read_pos += rest;
-				impl().m_position += rest;
-				to_read -= rest;
-			}
-			++impl().m_current_sector;
-			if (impl().m_current_sector >= impl().m_sector_positions.size())
-			{
-				impl().m_valid = false;
-				impl().m_error = "Read past EOF";
-				return false;
-			}
-			if (!impl().m_data_stream->seek(impl().m_sector_positions[impl().m_current_sector], SEEK_SET))
-			{
-				impl().m_error = "Cant seek to the next sector";
-				impl().m_valid = false;
-				return false;
-			}
-			impl().m_chunk_position = 0;
-		}
-	}
-	return true;
+	return impl().read(buf, length);
 }
 
 bool thread_safe_ole_stream_reader::seek(int offset, int whence)
@@ -169,20 +204,12 @@ bool thread_safe_ole_stream_reader::seek(int offset, int whence)
 		return false;
 	}
 	impl().m_position = new_position;
-	impl().m_current_sector = new_position / impl().m_sector_size;
-	impl().m_chunk_position = new_position - impl().m_current_sector * impl().m_sector_size;
-	if (impl().m_current_sector >= impl().m_sector_positions.size())
+	if (new_position < impl().m_size && impl().find_extent(new_position) == nullptr)
 	{
 		impl().m_valid = false;
 		impl().m_error = "Read past EOF";
 		return false;
 	}
-	if (!impl().m_data_stream->seek(impl().m_sector_positions[impl().m_current_sector] + impl().m_chunk_position, SEEK_SET))
-	{
-		impl().m_error = "Cant seek to the selected position";
-		impl().m_valid = false;
-		return false;
-	}
 	return true;
 }
 
@@ -214,86 +241,54 @@ S8 thread_safe_ole_stream_reader::readS8()
 
 bool thread_safe_ole_stream_reader::readU16(U16& data)
 {
-	#if defined(WORDS_BIGENDIAN)
-	return read((U8*)data + 1, 1) && read((U8*)data, 1);
-	#else
-	return read((U8*)&data, 2);
-	#endif
+	return impl().read_integer(data);
 }
 
 U16 thread_safe_ole_stream_reader::readU16()
 {
 	U16 data = 0;
-	#if defined(WORDS_BIGENDIAN)
-	if (!read((U8*)&data + 1, 1) || !read((U8*)&data, 1))
-	#else
-	if (!read((U8*)&data, 2))
-	#endif
+	if (!impl().read_integer(data))
 		return 0;
 	return data;
 }
 
 bool thread_safe_ole_stream_reader::readS16(S16& data)
 {
-	#if defined(WORDS_BIGENDIAN)
-	return read((U8*)&data + 1, 1) && read((U8*)&data, 1);
-	#else
-	return read((U8*)&data, 2);
-	#endif
+	return impl().read_integer(data);
 }
 
 S16 thread_safe_ole_stream_reader::readS16()
 {
-	U16 data = 0;
-	#if defined(WORDS_BIGENDIAN)
-	if (!read((U8*)&data + 1, 1) || !read((U8*)&data, 1))
-	#else
-	if (!read((U8*)&data, 2))
-	#endif
+	S16 data = 0;
+	if (!impl().read_integer(data))
 		return 0;
-	return (S16)data;
+	return data;
 }
 
 bool thread_safe_ole_stream_reader::readU32(U32& data)
 {
-	#if defined(WORDS_BIGENDIAN)
-	return read((U8*)&data + 3, 1) && read((U8*)&data + 2, 1) && read((U8*)&data + 1, 1) && read((U8*)&data, 1);
-	#else
-	return read((U8*)&data, 4);
-	#endif
+	return impl().read_integer(data);
 }
 
 U32 thread_safe_ole_stream_reader::readU32()
 {
 	U32 data = 0;
-	#if defined(WORDS_BIGENDIAN)
-	if (!read((U8*)&data + 3, 1) || !read((U8*)&data + 2, 1) || !read((U8*)&data + 1, 1) || !read((U8*)&data, 1))
-	#else
-	if (!read((U8*)&data, 4))
-	#endif
+	if (!impl().read_integer(data))
 		return 0;
 	return data;
 }
 
 bool thread_safe_ole_stream_reader::readS32(S32& data)
 {
-	#if defined(WORDS_BIGENDIAN)
-	return read((U8*)&data + 3, 1) && read((U8*)&data + 2, 1) && read((U8*)&data + 1, 1) && read((U8*)&data, 1);
-	#else
-	return read((U8*)&data, 4);
-	#endif
+	return impl().read_integer(data);
 }
 
 S32 thread_safe_ole_stream_reader::readS32()
 {
-	U32 data = 0;
-	#if defined(WORDS_BIGENDIAN)
-	if (!read((U8*)&data + 3, 1) || !read((U8*)&data + 2, 1) || !read((U8*)&data + 1, 1) || !read((U8*)&data, 1))
-	#else
-	if (!read((U8*)&data, 4))
-	#endif
+	S32 data = 0;
+	if (!impl().read_integer(data))
 		return 0;
-	return (S32)data;
+	return data;
 }
 
 } // namespace docwire
@@ -13,9 +13,11 @@
 #define DOCWIRE_THREAD_SAFE_OLE_STREAM_READER_H
 
 #include "core_export.h"
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include "pimpl.h"
+#include <span>
 #include <string>
 #include <vector>
 #include "wv2/src/olestream.h"
@@ -25,7 +27,6 @@ namespace docwire
 
 class thread_safe_ole_storage;
 using namespace wvWare;
-class data_stream;
 
 class DOCWIRE_CORE_EXPORT thread_safe_ole_stream_reader : public wvWare::OLEStreamReader, public with_pimpl<thread_safe_ole_stream_reader>
 {
@@ -36,7 +37,8 @@ class DOCWIRE_CORE_EXPORT thread_safe_ole_stream_reader : public wvWare::OLEStre
 			uint64_t m_size;
 			std::vector<uint32_t> m_file_positions;
 			uint32_t m_sector_size;
-			data_stream* m_data_stream;
+			/// Whole compound file. It must outlive the reader.
+			std::span<const std::byte> m_buffer;
 		};
 		thread_safe_ole_stream_reader(thread_safe_ole_storage* storage, stream& stream);
 	public:
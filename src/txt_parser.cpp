@@ -20,6 +20,9 @@
 #include "nested_exception.h"
 #include "pimpl.h"
 #include "serialization_data_source.h" // IWYU pragma: keep
+#include "throw_if.h"
+#include <algorithm>
+#include <optional>
 #include <string.h>
 
 namespace docwire
@@ -41,39 +44,175 @@ txt_parser::txt_parser(parse_paragraphs parse_paragraphs_arg, parse_lines parse_
 namespace
 {
 
-std::string sequences_of_printable_characters(const std::string& text, size_t min_seq_len = 4, char seq_delim = '\n')
+// Charset detection runs on a bounded prefix of the input and stops as soon as the detector is confident.
+// A prefix without any 8-bit byte says nothing about the rest of the input, so then detection continues
+// until the first 8-bit byte is seen or the detector is confident.
+constexpr size_t charset_detection_chunk_size = 64 * 1024;
+constexpr size_t charset_detection_sample_size = 1024 * 1024;
+
+// Input is converted to UTF-8 and split into lines in slices of this size, so the converted text never
+// has to be held in memory as a whole.
+constexpr size_t conversion_chunk_size = 256 * 1024;
+
+// Extracts sequences of printable characters from text delivered in chunks.
+class printable_sequences_extractor
+{
+public:
+	explicit printable_sequences_extractor(size_t min_seq_len = 4, char seq_delim = '\n')
+		: m_min_seq_len{min_seq_len}, m_seq_delim{seq_delim}
+	{}
+
+	void extract(std::string_view text, std::string& output)
+	{
+		for (auto const& ch: text)
+		{
+			if (std::isprint(static_cast<unsigned char>(ch)))
+			{
+				m_printable_field += ch;
+				m_printable_count++;
+				m_non_printable_count = 0;
+			}
+			else
+			{
+				if (m_printable_count >= m_min_seq_len)
+				{
+					output += m_printable_field;
+					if (m_non_printable_count == 0)
+						output += m_seq_delim;
+				}
+				m_printable_field.clear();
+				m_printable_count = 0;
+				m_non_printable_count++;
+			}
+		}
+	}
+
+	void finish(std::string& output)
+	{
+		output += m_printable_field;
+		m_printable_field.clear();
+	}
+
+private:
+	size_t m_min_seq_len;
+	char m_seq_delim;
+	std::string m_printable_field;
+	size_t m_printable_count = 0;
+	size_t m_non_printable_count = 0;
+};
+
+std::optional<std::string> detect_encoding(std::string_view content)
+{
+	log_scope();
+	csd_t charset_detector = csd_open();
+	throw_if(charset_detector == (csd_t)-1, "Could not create charset detector");
+	bool seen_8bit = false;
+	for (size_t pos = 0; pos < content.size(); pos += charset_detection_chunk_size)
+	{
+		if (pos >= charset_detection_sample_size && seen_8bit)
+			break;
+		std::string_view chunk = content.substr(pos, charset_detection_chunk_size);
+		if (csd_consider(charset_detector, chunk.data(), static_cast<int>(chunk.size())) != 0)
+			break;
+		seen_8bit = seen_8bit || std::any_of(chunk.begin(), chunk.end(), [](char ch) { return static_cast<unsigned char>(ch) & 0x80; });
+	}
+	const char* res = csd_close(charset_detector);
+	if (res == NULL)
+		return std::nullopt;
+	return std::string(res);
+}
+
+// Splits UTF-8 text into lines and paragraphs and emits them as document messages.
+class text_emitter
 {
-	log_scope(min_seq_len, seq_delim);
-	std::string result;
-	result.reserve(text.length());
-	std::string printable_field;
-	printable_field.reserve(text.length());
-	size_t printable_count = 0;
-	size_t non_printable_count = 0;
-	for (auto const& ch: text)
+public:
+	text_emitter(bool parse_paragraphs, bool parse_lines, const message_callbacks& emit_message)
+		: m_parse_paragraphs{parse_paragraphs}, m_parse_lines{parse_lines}, m_emit_message{emit_message}
+	{}
+
+	// Emits all complete lines from the beginning of the text and returns the number of bytes consumed.
+	// The remaining bytes have to be passed again, followed by more text, in the next call.
+	size_t consume(std::string_view text, bool last)
 	{
-		if (std::isprint(ch))
+		if (!m_parse_lines && !m_parse_paragraphs)
+		{
+			if (!last)
+				return 0;
+			m_emit_message(document::text{.text = std::string{text}});
+			return text.size();
+		}
+		size_t curr_pos = 0;
+		for (;;)
 		{
-			printable_field += ch;
-			printable_count++;
-			non_printable_count = 0;
+			size_t eol_pos = text.find_first_of("\r\n", curr_pos);
+			if (eol_pos == std::string_view::npos)
+			{
+				if (!last)
+					return curr_pos;
+				emit_line(text.substr(curr_pos), std::string_view{});
+				return text.size();
+			}
+			// CR at the end of the chunk can be the first half of CRLF.
+			if (text[eol_pos] == '\r' && eol_pos + 1 == text.size() && !last)
+				return curr_pos;
+			size_t eol_size = (text[eol_pos] == '\r' && eol_pos + 1 < text.size() && text[eol_pos + 1] == '\n') ? 2 : 1;
+			emit_line(text.substr(curr_pos, eol_pos - curr_pos), text.substr(eol_pos, eol_size));
+			curr_pos = eol_pos + eol_size;
+		}
+	}
+
+private:
+	bool m_parse_paragraphs;
+	bool m_parse_lines;
+	const message_callbacks& m_emit_message;
+	enum { outside_paragraph, empty_paragraph, filled_paragraph } m_paragraph_state = outside_paragraph;
+	std::string m_last_eol;
+
+	// An empty eol marks the last line of the text.
+	void emit_line(std::string_view line, std::string_view eol)
+	{
+		if (m_parse_paragraphs)
+		{
+			if (m_paragraph_state == outside_paragraph)
+			{
+				m_emit_message(document::paragraph{});
+				m_paragraph_state = empty_paragraph;
+			}
+			if (line.empty())
+			{
+				m_emit_message(document::close_paragraph{});
+				m_paragraph_state = outside_paragraph;
+			}
+			else
+			{
+				if (m_paragraph_state == filled_paragraph)
+				{
+					if (m_parse_lines)
+						m_emit_message(document::break_line{});
+					else
+						m_emit_message(document::text{.text = m_last_eol});
+				}
+				m_emit_message(document::text{.text = std::string{line}});
+				m_paragraph_state = filled_paragraph;
+			}
+			if (eol.empty() && m_paragraph_state != outside_paragraph)
+				m_emit_message(document::close_paragraph{});
 		}
 		else
 		{
-			if (printable_count >= min_seq_len)
+			if (!line.empty())
+				m_emit_message(document::text{.text = std::string{line}});
+			if (!eol.empty())
 			{
-				result += printable_field;
-				if (non_printable_count == 0)
-					result += seq_delim;
+				if (m_parse_lines)
+					m_emit_message(document::break_line{});
+				else
+					m_emit_message(document::text{.text = std::string{eol}});
 			}
-			printable_field.clear();
-			printable_count = 0;
-			non_printable_count++;
 		}
+		m_last_eol = eol;
 	}
-	result += printable_field;
-	return result;
-}
+};
 
 const std::vector<mime_type> supported_mime_types =
 {
@@ -120,134 +259,83 @@ const std::vector<mime_type> supported_mime_types =
 void pimpl_impl<txt_parser>::parse(const data_source& data, const message_callbacks& emit_message)
 {
 	log_scope(data);
-	std::string text;
-	csd_t charset_detector = NULL;
-	charset_converter* converter = NULL;
+	std::string_view content = data.string_view();
+	std::string encoding;
+	std::optional<printable_sequences_extractor> printable_sequences;
 	try
 	{
-		std::string encoding;
-		std::string content = data.string();
-		charset_detector = csd_open();
-		if (charset_detector == (csd_t)-1)
+		std::optional<std::string> detected_encoding = detect_encoding(content);
+		if (detected_encoding)
 		{
-			charset_detector = NULL;
-			emit_message(make_error_ptr("Could not create charset detector"));
-			encoding = "UTF-8";
+			encoding = *detected_encoding;
+			log_entry(encoding);
 		}
 		else
 		{
-			csd_consider(charset_detector, content.c_str(), content.length());
-			const char* res = csd_close(charset_detector);
-			charset_detector = NULL;
-			if (res != NULL)
-			{
-				encoding = std::string(res);
-				log_entry(encoding);
-			}
-			else
-			{
-				log_scope();
-				encoding = "ASCII"; // Assume ASCII as a fallback
-				content = sequences_of_printable_characters(content); // Extract printable sequences
-			}
+			log_scope();
+			encoding = "ASCII"; // Assume ASCII as a fallback
+			printable_sequences.emplace(); // Extract printable sequences
 		}
-		if (encoding != "utf-8" && encoding != "UTF-8")
+	}
+	catch (const std::exception&)
+	{
+		emit_message(std::current_exception());
+		encoding = "UTF-8";
+	}
+	std::optional<charset_converter> converter;
+	if (encoding != "utf-8" && encoding != "UTF-8")
+	{
+		log_scope(encoding);
+		try
 		{
-			log_scope(encoding);
-			try
-			{
-				converter = new charset_converter(encoding, "UTF-8");
-			}
-			catch (std::exception&)
-			{
-				emit_message(make_nested_ptr(std::current_exception(), make_error("Cannot convert text to UTF-8", encoding)));
-				if (converter)
-					delete converter;
-				converter = NULL;
-			}
+			converter.emplace(encoding, "UTF-8");
 		}
-		if (converter)
+		catch (std::exception&)
 		{
-			log_scope();
-			text = converter->convert(content);
-			delete converter;
-			converter = NULL;
+			emit_message(make_nested_ptr(std::current_exception(), make_error("Cannot convert text to UTF-8", encoding)));
 		}
-		else
-			text = content;
-	}
-	catch (const std::exception& e)
-	{
-		if (converter)
-			delete converter;
-		converter = NULL;
-		if (charset_detector)
-			csd_close(charset_detector);
-		charset_detector = NULL;
-		std::throw_with_nested(make_error("Error converting text to UTF-8"));
 	}
-	bool parse_paragraphs = m_parse_paragraphs.v;
-	bool parse_lines = m_parse_lines.v;
 	emit_message(document::document{});
-	if (parse_lines || parse_paragraphs)
+	text_emitter emitter{m_parse_paragraphs.v, m_parse_lines.v, emit_message};
+	std::string printable_text;
+	std::string text;
+	size_t chunk_pos = 0;
+	for (;;)
 	{
-		std::string::size_type curr_pos = 0;
-		enum { outside_paragraph, empty_paragraph, filled_paragraph } paragraph_state = outside_paragraph;
-		std::string last_eol = "";
-		for (;;)
+		std::string_view chunk = content.substr(chunk_pos, conversion_chunk_size);
+		chunk_pos += chunk.size();
+		bool last = chunk_pos >= content.size();
+		if (printable_sequences)
 		{
-			std::string::size_type eol_pos = text.find_first_of("\r\n", curr_pos);
-			std::string eol = (eol_pos == std::string::npos ? std::string{""} : text.substr(eol_pos, 1));
-			if (eol == "\r" && eol_pos + 1 < text.size() && text[eol_pos + 1] == '\n')
-				eol += '\n';
-			std::string line = text.substr(curr_pos, eol_pos - curr_pos);
-			if (parse_paragraphs)
+			printable_text.clear();
+			printable_sequences->extract(chunk, printable_text);
+			if (last)
+				printable_sequences->finish(printable_text);
+			chunk = printable_text;
+		}
+		if (converter)
+		{
+			size_t converted_size = text.size();
+			try
 			{
-				if (paragraph_state == outside_paragraph)
-				{
-					emit_message(document::paragraph{});
-					paragraph_state = empty_paragraph;
-				}
-				if (line.empty())
-				{
-					emit_message(document::close_paragraph{});
-					paragraph_state = outside_paragraph;
-				}
-				else
-				{
-					if (paragraph_state == filled_paragraph)
-					{
-						if (parse_lines)
-							emit_message(document::break_line{});
-						else
-							emit_message(document::text{.text = last_eol});
-					}
-					emit_message(document::text{.text = line});
-					paragraph_state = filled_paragraph;
-				}
+				converter->convert_part(chunk, last, text);
 			}
-			else
+			catch (const std::exception&)
 			{
-				if (!line.empty())
-					emit_message(document::text{.text = line});
-				if (!eol.empty())
-				{
-					if (parse_lines)
-						emit_message(document::break_line{});
-					else
-						emit_message(document::text{.text = eol});
-				}
+				// Part of the document was already emitted, so the rest is passed through unconverted
+				// instead of aborting, to keep the document balanced.
+				emit_message(make_nested_ptr(std::current_exception(), make_error("Error converting text to UTF-8", encoding)));
+				converter.reset();
+				text.resize(converted_size);
+				text.append(chunk);
 			}
-			if (eol.empty())
-				break;
-			curr_pos = eol_pos + eol.size();
-			last_eol = eol;
 		}
-		if (parse_paragraphs && paragraph_state != outside_paragraph)
-			emit_message(document::close_paragraph{});
+		else
+			text.append(chunk);
+		text.erase(0, emitter.consume(text, last));
+		if (last)
+			break;
 	}
-	else
-		emit_message(document::text{.text = text});
 	emit_message(document::close_document{});
 }
 
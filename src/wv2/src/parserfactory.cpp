@@ -33,14 +33,14 @@ namespace
         // Check if it's a Word 3, 4, or 5 file
         if ( buffer[0] == 0x31 && buffer[1] == 0xbe &&
              buffer[2] == 0x00 && buffer[3] == 0x00 )
-            std::cerr << "This is a Word 3, 4, or 5 file. Right now we don't handle these versions.\n"
+            wvlogTarget() << "This is a Word 3, 4, or 5 file. Right now we don't handle these versions.\n"
                       << "Please send us the file, maybe we will implement it later on." << std::endl;
         else if ( buffer[0] == 0xdb && buffer[1] == 0xa5 &&
                   buffer[2] == 0x2d && buffer[3] == 0x00 )
-            std::cerr << "This is a Word 2 document. Right now we don't handle this version." << std::endl
+            wvlogTarget() << "This is a Word 2 document. Right now we don't handle this version." << std::endl
                       << "Please send us the file, maybe we will implement it later on." << std::endl;
         else
-            std::cerr << "That doesn't seem to be a Word document." << std::endl;
+            wvlogTarget() << "That doesn't seem to be a Word document." << std::endl;
     }
 
     SharedPtr<Parser> setupParser( OLEStorage* storage )
@@ -48,7 +48,7 @@ namespace
         // Is it called WordDocument in all versions?
         OLEStreamReader* wordDocument = storage->createStreamReader( "WordDocument" );
         if ( !wordDocument || !wordDocument->isValid() ) {
-            std::cerr << "Error: No 'WordDocument' stream found. Are you sure this is a Word document?" << std::endl;
+            wvlogTarget() << "Error: No 'WordDocument' stream found. Are you sure this is a Word document?" << std::endl;
             delete wordDocument;
             delete storage;
             return 0;
@@ -63,7 +63,7 @@ namespace
         wordDocument->seek( 0 );  // rewind the stream
 
         if ( nFib < 101 ) {
-            std::cerr << "+++ Don't know how to handle nFib=" << nFib << std::endl;
+            wvlogTarget() << "+++ Don't know how to handle nFib=" << nFib << std::endl;
             delete wordDocument;
             delete storage;
             return 0;
@@ -109,7 +109,7 @@ SharedPtr<Parser> ParserFactory::createParser( OLEStorage* storage )
         unsigned char buffer[4];
         if (!storage->readDirectFromBuffer(buffer, 4, 0))
         {
-            std::cerr << "Couldn't open " << storage->name().c_str() << " for reading." << std::endl;
+            wvlogTarget() << "Couldn't open " << storage->name().c_str() << " for reading." << std::endl;
             delete storage;
             return 0;
         }
@@ -32,9 +32,17 @@
 
 #include "wvlog.h"
 #include <errno.h>
+#include <mutex>
 
 using namespace wvWare;
 
+namespace
+{
+    // iconv_open isn't entirely thread-safe in glibc (it races on the cache of gconv modules),
+    // and documents may be parsed by several threads at once.
+    std::mutex iconvOpenMutex;
+}
+
 class TextConverter::Private
 {
 public:
@@ -323,8 +331,10 @@ void TextConverter::open()
     if ( d->m_fromCode == "not known" )
         wvlog << "Warning: We don't know the current charset you want to convert from!" << std::endl;
 
-    if ( !d->m_toCode.empty() && !d->m_fromCode.empty() )
+    if ( !d->m_toCode.empty() && !d->m_fromCode.empty() ) {
+        std::lock_guard<std::mutex> lock( iconvOpenMutex );
         d->m_iconv = iconv_open( d->m_toCode.c_str(), d->m_fromCode.c_str() );
+    }
 }
 
 U16 TextConverter::fixLID( U16 nLocale )
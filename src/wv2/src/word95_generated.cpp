@@ -2130,6 +2130,11 @@ BTE::BTE(OLEStreamReader *stream, bool preservePos) {
     read(stream, preservePos);
 }
 
+BTE::BTE(const U8 *ptr) {
+    clear();
+    readPtr(ptr);
+}
+
 bool BTE::read(OLEStreamReader *stream, bool preservePos) {
 
     if(preservePos)
@@ -2142,6 +2147,12 @@ bool BTE::read(OLEStreamReader *stream, bool preservePos) {
     return true;
 }
 
+void BTE::readPtr(const U8 *ptr) {
+
+    pn=readU16(ptr);
+    ptr+=sizeof(U16);
+}
+
 void BTE::clear() {
     pn=0;
 }
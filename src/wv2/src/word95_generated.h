@@ -1891,6 +1891,10 @@ struct BTE {
      * Simply calls read(...)
      */
     BTE(OLEStreamReader *stream, bool preservePos=false);
+    /**
+     * Simply calls readPtr(...)
+     */
+    BTE(const U8 *ptr);
 
     /**
      * This method reads the BTE structure from the stream.
@@ -1900,6 +1904,11 @@ struct BTE {
      */
     bool read(OLEStreamReader *stream, bool preservePos=false);
 
+    /**
+     * This method reads the struct from a pointer
+     */
+    void readPtr(const U8 *ptr);
+
     /**
      * Set all the fields to the inital value (default is 0)
      */
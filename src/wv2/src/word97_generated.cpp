@@ -2289,6 +2289,11 @@ BTE::BTE(OLEStreamReader *stream, bool preservePos) {
     read(stream, preservePos);
 }
 
+BTE::BTE(const U8 *ptr) {
+    clear();
+    readPtr(ptr);
+}
+
 bool BTE::read(OLEStreamReader *stream, bool preservePos) {
 
     if(preservePos)
@@ -2301,6 +2306,12 @@ bool BTE::read(OLEStreamReader *stream, bool preservePos) {
     return true;
 }
 
+void BTE::readPtr(const U8 *ptr) {
+
+    pn=readU32(ptr);
+    ptr+=sizeof(U32);
+}
+
 void BTE::clear() {
     pn=0;
 }
@@ -4400,6 +4411,11 @@ FRD::FRD(OLEStreamReader *stream, bool preservePos) {
     read(stream, preservePos);
 }
 
+FRD::FRD(const U8 *ptr) {
+    clear();
+    readPtr(ptr);
+}
+
 bool FRD::read(OLEStreamReader *stream, bool preservePos) {
 
     if(preservePos)
@@ -4412,6 +4428,12 @@ bool FRD::read(OLEStreamReader *stream, bool preservePos) {
     return true;
 }
 
+void FRD::readPtr(const U8 *ptr) {
+
+    nAuto=readS16(ptr);
+    ptr+=sizeof(S16);
+}
+
 void FRD::clear() {
     nAuto=0;
 }
@@ -6280,6 +6302,11 @@ SED::SED(OLEStreamReader *stream, bool preservePos) {
     read(stream, preservePos);
 }
 
+SED::SED(const U8 *ptr) {
+    clear();
+    readPtr(ptr);
+}
+
 bool SED::read(OLEStreamReader *stream, bool preservePos) {
 
     if(preservePos)
@@ -6295,6 +6322,18 @@ bool SED::read(OLEStreamReader *stream, bool preservePos) {
     return true;
 }
 
+void SED::readPtr(const U8 *ptr) {
+
+    fn=readS16(ptr);
+    ptr+=sizeof(S16);
+    fcSepx=readU32(ptr);
+    ptr+=sizeof(U32);
+    fnMpr=readS16(ptr);
+    ptr+=sizeof(S16);
+    fcMpr=readU32(ptr);
+    ptr+=sizeof(U32);
+}
+
 void SED::clear() {
     fn=0;
     fcSepx=0;
@@ -2276,6 +2276,10 @@ struct BTE {
      * Simply calls read(...)
      */
     BTE(OLEStreamReader *stream, bool preservePos=false);
+    /**
+     * Simply calls readPtr(...)
+     */
+    BTE(const U8 *ptr);
 
     /**
      * This method reads the BTE structure from the stream.
@@ -2285,6 +2289,11 @@ struct BTE {
      */
     bool read(OLEStreamReader *stream, bool preservePos=false);
 
+    /**
+     * This method reads the struct from a pointer
+     */
+    void readPtr(const U8 *ptr);
+
     /**
      * Set all the fields to the inital value (default is 0)
      */
@@ -5514,6 +5523,10 @@ struct FRD {
      * Simply calls read(...)
      */
     FRD(OLEStreamReader *stream, bool preservePos=false);
+    /**
+     * Simply calls readPtr(...)
+     */
+    FRD(const U8 *ptr);
 
     /**
      * This method reads the FRD structure from the stream.
@@ -5523,6 +5536,11 @@ struct FRD {
      */
     bool read(OLEStreamReader *stream, bool preservePos=false);
 
+    /**
+     * This method reads the struct from a pointer
+     */
+    void readPtr(const U8 *ptr);
+
     /**
      * Set all the fields to the inital value (default is 0)
      */
@@ -7729,6 +7747,10 @@ struct SED {
      * Simply calls read(...)
      */
     SED(OLEStreamReader *stream, bool preservePos=false);
+    /**
+     * Simply calls readPtr(...)
+     */
+    SED(const U8 *ptr);
 
     /**
      * This method reads the SED structure from the stream.
@@ -7738,6 +7760,11 @@ struct SED {
      */
     bool read(OLEStreamReader *stream, bool preservePos=false);
 
+    /**
+     * This method reads the struct from a pointer
+     */
+    void readPtr(const U8 *ptr);
+
     /**
      * Set all the fields to the inital value (default is 0)
      */
@@ -22,6 +22,7 @@
 #include "olestream.h"
 #include "wvlog.h"
 
+#include <type_traits>
 #include <vector>
 #include <string.h>
 
@@ -209,6 +210,11 @@ namespace wvWare
         PLCF() {}
 
         U32 calculateCount( U32 length );
+        // Reads the whole PLCF with a single stream read and decodes it from
+        // memory, if T can be constructed from a raw pointer
+        void readItems( U32 count, OLEStreamReader* reader, std::true_type );
+        void readItems( U32 count, OLEStreamReader* reader, std::false_type );
+        void readItems( U32 count, const U8* ptr );
 
         std::vector<U32> m_indices;
         std::vector<T*> m_items;
@@ -219,21 +225,48 @@ namespace wvWare
     {
         if ( preservePos )
             reader->push();
-        U32 count = calculateCount( length );
+        readItems( calculateCount( length ), reader, std::is_constructible<T, const U8*>() );
+        if ( preservePos )
+            reader->pop();
+    }
+
+    template<class T>
+    PLCF<T>::PLCF( U32 length, const U8* ptr )
+    {
+        readItems( calculateCount( length ), ptr );
+    }
+
+    template<class T>
+    void PLCF<T>::readItems( U32 count, OLEStreamReader* reader, std::true_type )
+    {
+        const size_t bytes = ( static_cast<size_t>( count ) + 1 ) * 4 + static_cast<size_t>( count ) * T::sizeOf;
+        const int pos = reader->tell();
+        if ( pos < 0 || reader->size() < bytes || reader->size() - bytes < static_cast<size_t>( pos ) ) {
+            // Truncated stream, keep the old per-field behavior
+            readItems( count, reader, std::false_type() );
+            return;
+        }
+        std::vector<U8> buffer( bytes );
+        reader->read( buffer.data(), bytes );
+        readItems( count, buffer.data() );
+    }
+
+    template<class T>
+    void PLCF<T>::readItems( U32 count, OLEStreamReader* reader, std::false_type )
+    {
         for ( U32 i = 0; i < count + 1; ++i )  // n+1 CPs/FCs
             m_indices.push_back( reader->readU32() );
         for ( U32 i = 0; i < count; ++i )  // n "T"s
             m_items.push_back( new T( reader, false ) );
-        if ( preservePos )
-            reader->pop();
     }
 
     template<class T>
-    PLCF<T>::PLCF( U32 length, const U8* ptr )
+    void PLCF<T>::readItems( U32 count, const U8* ptr )
     {
-        U32 count = calculateCount( length );
+        m_indices.reserve( count + 1 );
         for ( U32 i = 0; i < count + 1; ++i, ptr += 4 )  // n+1 CPs/FCs
             m_indices.push_back( readU32( ptr ) );
+        m_items.reserve( count );
         for ( U32 i = 0; i < count; ++i, ptr += T::sizeOf )  // n "T"s
             m_items.push_back( new T( ptr ) );
     }
@@ -430,6 +463,8 @@ namespace wvWare
         // unless you know what you are doing :-)
         FKP() {}
 
+        void init( const U8* ptr );
+
         U8 m_crun;
         U32* m_rgfc;  // array of FCs (crun+1)
         Offset* m_rgb;  // array of offsets/BXs
@@ -440,37 +475,45 @@ namespace wvWare
     template<class Offset>
     FKP<Offset>::FKP( OLEStreamReader* reader, bool preservePos )
     {
+        // Read the whole 512 byte page at once and decode it from memory
+        U8 page[ 512 ];
         if ( preservePos )
             reader->push();
-        reader->push();
-        reader->seek( 511, G_SEEK_CUR );
-        m_crun = reader->readU8();
-        reader->pop();
-
-        m_rgfc = new U32[ m_crun + 1 ];
-        for ( U8 i = 0; i <= m_crun; ++i )  // <= crun, because of crun+1 FCs!
-            m_rgfc[ i ] = reader->readU32();
-
-        m_rgb = new Offset[ m_crun ];
-        for ( U8 i = 0; i < m_crun; ++i )
-            m_rgb[ i ].read( reader, false );
-
-        m_internalOffset = ( static_cast<U16>( m_crun ) + 1 ) * 4 + static_cast<U16>( m_crun ) * Offset::sizeOf;
-
-        // store the rest of the FKP in an internal array for later use
-        const U16 length = 511 - m_internalOffset;
-        m_fkp = new U8[ length ];  // 511, because we don't need crun
-        for ( U16 i = 0; i < length; ++i )
-            m_fkp[ i ] = reader->readU8();
-
+        const int pos = reader->tell();
+        if ( pos >= 0 && reader->size() >= 512 && reader->size() - 512 >= static_cast<size_t>( pos ) ) {
+            reader->read( page, 512 );
+            reader->seek( -1, G_SEEK_CUR );  // crun isn't part of the "rest" we consumed
+        }
+        else {
+            // Truncated stream, collect whatever the reader returns
+            reader->push();
+            reader->seek( 511, G_SEEK_CUR );
+            page[ 511 ] = reader->readU8();
+            reader->pop();
+            for ( U16 i = 0; i < 511; ++i )
+                page[ i ] = reader->readU8();
+        }
         if ( preservePos )
             reader->pop();
+        init( page );
     }
 
     template<class Offset>
     FKP<Offset>::FKP( const U8* ptr )
+    {
+        init( ptr );
+    }
+
+    template<class Offset>
+    void FKP<Offset>::init( const U8* ptr )
     {
         m_crun = ptr[ 511 ];
+        // A corrupt crun must not make the FCs and offsets run past the page
+        const U8 maxCrun = 507 / ( 4 + Offset::sizeOf );
+        if ( m_crun > maxCrun ) {
+            wvlog << "Warning: FKP crun " << static_cast<int>( m_crun ) << " exceeds the page, clamping to " << static_cast<int>( maxCrun ) << std::endl;
+            m_crun = maxCrun;
+        }
 
         m_rgfc = new U32[ m_crun + 1 ];
         for ( U8 i = 0; i <= m_crun; ++i, ptr += 4 )  // <= crun, because of crun+1 FCs!
@@ -483,10 +526,9 @@ namespace wvWare
         m_internalOffset = ( static_cast<U16>( m_crun ) + 1 ) * 4 + static_cast<U16>( m_crun ) * Offset::sizeOf;
 
         // store the rest of the FKP in an internal array for later use
-        U16 length = 511 - m_internalOffset;
+        const U16 length = 511 - m_internalOffset;
         m_fkp = new U8[ length ];  // 511, because we don't need crun
-        for ( U16 i = 0; i < length; ++i, ++ptr )
-            m_fkp[ i ] = *ptr;
+        ::memcpy( m_fkp, ptr, length );
     }
 
     template<class Offset>
@@ -21,4 +21,24 @@
 namespace wvWare
 {
     const wvlogstream wvlog = wvlog;
+
+    namespace
+    {
+        thread_local std::ostream* s_target = 0;
+    }
+
+    std::ostream& wvlogTarget()
+    {
+        return s_target ? *s_target : std::cerr;
+    }
+
+    WvLogCapture::WvLogCapture( std::ostream& target ) : m_previous( s_target )
+    {
+        s_target = &target;
+    }
+
+    WvLogCapture::~WvLogCapture()
+    {
+        s_target = m_previous;
+    }
 } // wvWare
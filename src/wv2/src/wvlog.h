@@ -19,6 +19,7 @@
 #ifndef WVLOG_H
 #define WVLOG_H
 
+#include "dllmagic.h"
 #include <iostream>
 #include <string>     // Make gcc 2.95.x happy
 
@@ -37,37 +38,61 @@
 namespace wvWare
 {
 
+    /**
+     * Returns the stream the diagnostic output of the current thread goes to.
+     * It's std::cerr unless a WvLogCapture is active on this thread.
+     */
+    WV2_DLLEXPORT std::ostream& wvlogTarget();
+
+    /**
+     * Redirects the diagnostic output of the current thread to the given stream
+     * for the lifetime of the object. Other threads are not affected, so documents
+     * can be parsed concurrently without swapping the buffer of std::cerr.
+     */
+    class WV2_DLLEXPORT WvLogCapture
+    {
+    public:
+        explicit WvLogCapture( std::ostream& target );
+        ~WvLogCapture();
+
+    private:
+        WvLogCapture( const WvLogCapture& rhs );
+        WvLogCapture& operator=( const WvLogCapture& rhs );
+
+        std::ostream* m_previous;
+    };
+
     class wvdebugstream
     {
     public:
 #ifdef WV2_OLD_STL_WORKAROUND
-        const wvdebugstream& operator<<( ostream& (*__pf)( ostream& ) ) const { std::cerr << __pf; return *this; }
-        const wvdebugstream& operator<<( ios (*__pf)( ios& ) ) const { std::cerr << __pf; return *this; }
+        const wvdebugstream& operator<<( ostream& (*__pf)( ostream& ) ) const { wvlogTarget() << __pf; return *this; }
+        const wvdebugstream& operator<<( ios (*__pf)( ios& ) ) const { wvlogTarget() << __pf; return *this; }
 #else
-        const wvdebugstream& operator<<( std::basic_ostream<char>& (*__pf)( std::basic_ostream<char>& ) ) const { std::cerr << __pf; return *this; }
-        const wvdebugstream& operator<<( std::ios (*__pf)( std::ios& ) ) const { std::cerr << __pf; return *this; }
-        const wvdebugstream& operator<<( std::ios_base& (*__pf) ( std::ios_base& ) ) const { std::cerr << __pf; return *this; }
+        const wvdebugstream& operator<<( std::basic_ostream<char>& (*__pf)( std::basic_ostream<char>& ) ) const { wvlogTarget() << __pf; return *this; }
+        const wvdebugstream& operator<<( std::ios (*__pf)( std::ios& ) ) const { wvlogTarget() << __pf; return *this; }
+        const wvdebugstream& operator<<( std::ios_base& (*__pf) ( std::ios_base& ) ) const { wvlogTarget() << __pf; return *this; }
 #endif
-        const wvdebugstream& operator<<( long l ) const { std::cerr << l; return *this; }
-        const wvdebugstream& operator<<( unsigned long l ) const { std::cerr << l; return *this; }
-        const wvdebugstream& operator<<( bool b ) const { std::cerr << b; return *this; }
-        const wvdebugstream& operator<<( short s ) const { std::cerr << s; return *this; }
-        const wvdebugstream& operator<<( unsigned short s ) const { std::cerr << s; return *this; }
-        const wvdebugstream& operator<<( int i ) const { std::cerr << i; return *this; }
-        const wvdebugstream& operator<<( unsigned int i ) const { std::cerr << i; return *this; }
-        const wvdebugstream& operator<<( double d ) const { std::cerr << d; return *this; }
-        const wvdebugstream& operator<<( float f ) const { std::cerr << f; return *this; }
-        const wvdebugstream& operator<<( long double d ) const { std::cerr << d; return *this; }
-        const wvdebugstream& operator<<( const void* cv ) const { std::cerr << cv; return *this; }
+        const wvdebugstream& operator<<( long l ) const { wvlogTarget() << l; return *this; }
+        const wvdebugstream& operator<<( unsigned long l ) const { wvlogTarget() << l; return *this; }
+        const wvdebugstream& operator<<( bool b ) const { wvlogTarget() << b; return *this; }
+        const wvdebugstream& operator<<( short s ) const { wvlogTarget() << s; return *this; }
+        const wvdebugstream& operator<<( unsigned short s ) const { wvlogTarget() << s; return *this; }
+        const wvdebugstream& operator<<( int i ) const { wvlogTarget() << i; return *this; }
+        const wvdebugstream& operator<<( unsigned int i ) const { wvlogTarget() << i; return *this; }
+        const wvdebugstream& operator<<( double d ) const { wvlogTarget() << d; return *this; }
+        const wvdebugstream& operator<<( float f ) const { wvlogTarget() << f; return *this; }
+        const wvdebugstream& operator<<( long double d ) const { wvlogTarget() << d; return *this; }
+        const wvdebugstream& operator<<( const void* cv ) const { wvlogTarget() << cv; return *this; }
 #ifdef WV2_OLD_STL_WORKAROUND
-        const wvdebugstream& operator<<( streambuf* s ) const { std::cerr << s; return *this; }
+        const wvdebugstream& operator<<( streambuf* s ) const { wvlogTarget() << s; return *this; }
 #else
-        const wvdebugstream& operator<<( std::basic_streambuf<char>* s ) const { std::cerr << s; return *this; }
+        const wvdebugstream& operator<<( std::basic_streambuf<char>* s ) const { wvlogTarget() << s; return *this; }
 #endif
-        const wvdebugstream& operator<<( signed char c ) const { std::cerr << c; return *this; }
-        const wvdebugstream& operator<<( unsigned char c ) const { std::cerr << c; return *this; }
-        const wvdebugstream& operator<<( const char* s ) const { std::cerr << s; return *this; }
-        const wvdebugstream& operator<<( const std::string& s ) const { std::cerr << s; return *this; }
+        const wvdebugstream& operator<<( signed char c ) const { wvlogTarget() << c; return *this; }
+        const wvdebugstream& operator<<( unsigned char c ) const { wvlogTarget() << c; return *this; }
+        const wvdebugstream& operator<<( const char* s ) const { wvlogTarget() << s; return *this; }
+        const wvdebugstream& operator<<( const std::string& s ) const { wvlogTarget() << s; return *this; }
     };
 
 
@@ -11,6 +11,7 @@
 
 #include "xls_parser.h"
 
+#include "charset_converter.h"
 #include "data_source.h"
 #include "document_elements.h"
 #include "error_tags.h"
@@ -19,7 +20,7 @@
 #include <map>
 #include <math.h>
 #include "misc.h"
-#include <mutex>
+#include <memory>
 #include "nested_exception.h"
 #include "oshared.h"
 #include <set>
@@ -28,7 +29,6 @@
 #include <string.h>
 #include "scoped_stack_push.h"
 #include "throw_if.h"
-#include "wv2/src/textconverter.h"
 #include "wv2/src/utilities.h"
 #include <vector>
 #include <time.h>
@@ -42,9 +42,6 @@ namespace docwire
 
 namespace
 {
-	std::mutex xls_converter_mutex;
-	std::mutex parser_mutex;
-
 enum record_type
 {
 	XLS_BOF = 0x809,
@@ -80,6 +77,8 @@ struct context
 {
 	const message_callbacks& emit_message;
 	std::string m_codepage = "cp1251";
+	std::unique_ptr<charset_converter> m_converter; // for m_codepage, created on first use
+	bool m_converter_unavailable = false;
 	biff_version m_biff_version;
 	std::vector<xf_record> m_xf_records;
 	double m_date_shift;
@@ -239,6 +238,49 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 		return formatXLSNumber(number, xf_index);
 	}
 
+	// Decodes a run of 8-bit characters in the code page of the workbook to UTF-8.
+	std::string decodeByteString(const std::string& bytes)
+	{
+		context& ctx = m_context_stack.top();
+		if (bytes.empty() || ctx.m_codepage == "ASCII")
+			return bytes;
+		if (!ctx.m_converter && !ctx.m_converter_unavailable)
+		{
+			try
+			{
+				ctx.m_converter = std::make_unique<charset_converter>(ctx.m_codepage, "UTF-8");
+			}
+			catch (const std::exception&)
+			{
+				emit_message(errors::make_nested_ptr(std::current_exception(), make_error("Unsupported code page", ctx.m_codepage)));
+				ctx.m_converter_unavailable = true;
+			}
+		}
+		if (!ctx.m_converter)
+			return "";
+		try
+		{
+			return ctx.m_converter->convert(bytes);
+		}
+		catch (const std::exception&)
+		{
+			// Characters that are not defined in the code page are skipped, the rest of the run is kept.
+			std::string dest;
+			for (char c : bytes)
+			{
+				try
+				{
+					dest += ctx.m_converter->convert(std::string_view{&c, 1});
+				}
+				catch (const std::exception&)
+				{
+					log_entry(static_cast<int>(static_cast<unsigned char>(c)));
+				}
+			}
+			return dest;
+		}
+	}
+
 	std::string parseXLUnicodeString(std::vector<unsigned char>::const_iterator* src, std::vector<unsigned char>::const_iterator src_end, const std::vector<size_t>& record_sizes, size_t& record_index, size_t& record_pos)
 	{
 		log_scope();
@@ -311,6 +353,13 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 		}
 		log_entry(after_text_block_len);
 		std::string dest;
+		// 8-bit characters are collected and decoded in runs, not one by one.
+		std::string byte_run;
+		auto flush_byte_run = [&]()
+		{
+			dest += decodeByteString(byte_run);
+			byte_run.clear();
+		};
 		std::vector<unsigned char>::const_iterator s = *src;
 		int char_count = 0;
 		for (int i = 0; i < count; i++, s += char_size, record_pos += char_size)
@@ -319,6 +368,7 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 			{
 				emit_message(make_error_ptr("Unexpected end of buffer."));
 				*src = src_end;
+				flush_byte_run();
 				return dest;
 			}
 			if (record_pos > record_sizes[record_index])
@@ -336,6 +386,7 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 				{
 					emit_message(make_error_ptr("Unexpected end of buffer."));
 					*src = src_end;
+					flush_byte_run();
 					return dest;
 				}
 				if ((*s) != 0 && (*s) != 1)
@@ -351,6 +402,7 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 			}
 			if (char_size == 2)
 			{
+				flush_byte_run();
 				if (src_end - *src < 2)
 				{
 					emit_message(make_error_ptr("Unexpected end of buffer."));
@@ -382,20 +434,14 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 				{
 					emit_message(make_error_ptr("Unexpected end of buffer."));
 					*src = src_end;
+					flush_byte_run();
 					return dest;
 				}
-				std::string c2(1, *s);
-				if (m_context_stack.top().m_codepage != "ASCII")
-				{
-					std::lock_guard<std::mutex> xls_converter_mutex_lock(xls_converter_mutex);
-					TextConverter tc(m_context_stack.top().m_codepage);
-					dest += ustring_to_string(tc.convert(c2));
-				}
-				else
-					dest += c2;
+				byte_run += static_cast<char>(*s);
 				char_count++;
 			}
 		}
+		flush_byte_run();
 		*src = s + after_text_block_len;
 		record_pos += after_text_block_len;
 		return dest;
@@ -476,6 +522,8 @@ struct pimpl_impl<xls_parser> : pimpl_impl_base
 						m_context_stack.top().m_codepage = "ASCII";
 					else
 						m_context_stack.top().m_codepage = "cp" + int2string(codepage);
+					m_context_stack.top().m_converter.reset();
+					m_context_stack.top().m_converter_unavailable = false;
 				}
 				break;
 			}
@@ -930,7 +978,6 @@ std::string pimpl_impl<xls_parser>::parse(thread_safe_ole_storage& storage, cons
 	scoped::stack_push<context> context_guard{m_context_stack, context{.emit_message = emit_message}};
 	try
 	{
-		std::lock_guard<std::mutex> parser_mutex_lock(parser_mutex);
 		std::unique_ptr<thread_safe_ole_stream_reader> workbook_reader { static_cast<thread_safe_ole_stream_reader*>(storage.createStreamReader("Workbook")) };
 		std::string text;
 		if (workbook_reader != nullptr)
@@ -10,7 +10,9 @@
 /*********************************************************************************************************************************************/
 
 #include "chaining.h"
+#include "charset_converter.h"
 #include "convert_chrono.h" // IWYU pragma: keep
+#include "concurrent_lru_cache.h"
 #include "ensure.h"
 #include "lru_memory_cache.h"
 #include "named.h"
@@ -27,6 +29,7 @@
 #include <memory>
 #include <functional>
 #include <chrono>
+#include <thread>
 
 using namespace docwire;
 
@@ -59,6 +62,59 @@ TEST(lru_cache, storing_and_retrieving_values)
         ASSERT_EQ(cache.get_or_create("key" + std::to_string(i), [](const std::string& key) { return key + " new value"; }), "key" + std::to_string(i) + " cached value");
 }
 
+TEST(concurrent_lru_cache, evicting_by_weight_and_counting)
+{
+    concurrent_lru_cache<int, std::string> cache{10, [](const int&, const std::string& value) { return value.size(); }, 1};
+    ASSERT_EQ(cache.get_or_create(1, [](const int&) { return std::string{"aaaa"}; }), "aaaa");
+    ASSERT_EQ(cache.get_or_create(2, [](const int&) { return std::string{"bbbb"}; }), "bbbb");
+    ASSERT_EQ(cache.find(1), "aaaa"); // 1 is now more recently used than 2
+    cache.put(3, "cccc");
+    EXPECT_EQ(cache.find(2), std::nullopt);
+    EXPECT_EQ(cache.find(1), "aaaa");
+    EXPECT_EQ(cache.find(3), "cccc");
+    cache.put(4, "too heavy to be stored");
+    EXPECT_EQ(cache.find(4), std::nullopt);
+    auto statistics = cache.get_statistics();
+    EXPECT_EQ(statistics.hits, 3);
+    EXPECT_EQ(statistics.misses, 4);
+    EXPECT_EQ(statistics.evictions, 1);
+    EXPECT_EQ(statistics.entries, 2);
+    EXPECT_EQ(statistics.weight, 8);
+}
+
+TEST(concurrent_lru_cache, sharing_budget_between_shards)
+{
+    // Every key goes to a different one of the default 16 shards, and every entry is heavier than 1/16 of the budget.
+    concurrent_lru_cache<int, std::string> cache{100, [](const int&, const std::string& value) { return value.size(); }};
+    cache.put(1, std::string(40, 'a'));
+    cache.put(2, std::string(40, 'b'));
+    EXPECT_EQ(cache.find(1), std::string(40, 'a'));
+    EXPECT_EQ(cache.find(2), std::string(40, 'b'));
+    cache.put(3, std::string(40, 'c'));
+    EXPECT_EQ(cache.find(3), std::string(40, 'c'));
+    auto statistics = cache.get_statistics();
+    EXPECT_EQ(statistics.evictions, 1);
+    EXPECT_EQ(statistics.entries, 2);
+    EXPECT_EQ(statistics.weight, 80);
+}
+
+TEST(concurrent_lru_cache, sharing_between_threads)
+{
+    concurrent_lru_cache<int, std::shared_ptr<int>> cache{1000, [](const int&, const std::shared_ptr<int>&) { return size_t{1}; }};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&cache]()
+        {
+            for (int i = 0; i < 1000; i++)
+                ASSERT_EQ(*cache.get_or_create(i % 100, [](const int& key) { return std::make_shared<int>(key); }), i % 100);
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    auto statistics = cache.get_statistics();
+    EXPECT_EQ(statistics.hits + statistics.misses, 4000);
+    EXPECT_EQ(statistics.entries, 100);
+}
+
 TEST(Convert, Chrono)
 {
     using namespace docwire::serialization;
@@ -400,3 +456,16 @@ TEST(ref_or_owned, general)
     test_ref_or_owned<test_base, test_base>(1);
     test_ref_or_owned<test_base, test_derived>(2);
 }
+
+TEST(charset_converter, reusing_cached_descriptors)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        charset_converter converter("CP1250", "UTF-8");
+        ASSERT_EQ(converter.convert("\xB9\x9C\xE6"), "\xC4\x85\xC5\x9B\xC4\x87");
+    }
+    std::unique_ptr<charset_converter> converter;
+    std::thread([&converter]() { converter = std::make_unique<charset_converter>("UTF-16LE", "UTF-8"); }).join();
+    ASSERT_EQ(converter->convert(std::string_view{"a\0b\0", 4}), "ab");
+    converter.reset();
+}
@@ -2,6 +2,7 @@
 #include "file_extension.h"
 #include "gtest/gtest.h"
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -120,3 +121,20 @@ TEST(DataSource, incremental_seekable_stream_ptr)
 {
     test_data_source_incremental<seekable_stream_ptr>();
 }
+
+TEST(DataSource, memory_buffer_producer)
+{
+    std::string test_data_str = create_datasource_test_data_str();
+    int calls = 0;
+    data_source data{memory_buffer_producer{[&test_data_str, &calls]()
+        {
+            calls++;
+            auto buffer = std::make_shared<memory_buffer>(test_data_str.size());
+            std::memcpy(buffer->data(), test_data_str.data(), test_data_str.size());
+            return buffer;
+        }}, mime_type{"text/plain"}, confidence::highest};
+    ASSERT_EQ(calls, 0);
+    ASSERT_EQ(data.string(), test_data_str);
+    ASSERT_EQ(data.string_view(length_limit{256}), test_data_str.substr(0, 256));
+    ASSERT_EQ(calls, 1);
+}
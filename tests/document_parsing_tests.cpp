@@ -34,13 +34,18 @@
 #include "standard_filter.h"
 #include <optional>
 #include <algorithm>
+#include <random>
+#include <set>
 #include "ocr_parser.h"
 #include "office_formats_parser.h"
 #include "output.h"
+#include "pdf_parser.h"
 #include "plain_text_exporter.h"
+#include "pst_parser.h"
 #include "transformer_func.h"
 #include "input.h"
 #include "log.h"
+#include "mail_elements.h"
 
 using namespace docwire;
 
@@ -523,3 +528,389 @@ INSTANTIATE_TEST_SUITE_P(
           std::string name = std::string{ std::get<2>(info.param) } + "_multi_page_filter_tests";
           return name;
         });
+
+TEST(pdf_parser, page_range)
+{
+    std::ostringstream output_stream{};
+    std::filesystem::path{"multi_pages_1.pdf"} |
+        content_type::by_file_extension::detector{} |
+        pdf_parser{pdf::pages{1, 2}} |
+        plain_text_exporter() |
+        output_stream;
+    EXPECT_EQ(output_stream.str().find("First page"), std::string::npos);
+    EXPECT_NE(output_stream.str().find("Second page"), std::string::npos);
+}
+
+TEST(pdf_parser, metadata_only)
+{
+    std::vector<message_ptr> msgs;
+    std::filesystem::path{"multi_pages_1.pdf"} |
+        content_type::by_file_extension::detector{} |
+        pdf_parser{pdf::pages{}, pdf::metadata_only{true}} |
+        msgs;
+    ASSERT_EQ(msgs.size(), 2);
+    ASSERT_TRUE(msgs[0]->is<document::document>());
+    EXPECT_EQ(msgs[0]->get<document::document>().metadata().page_count, 2);
+    EXPECT_TRUE(msgs[1]->is<document::close_document>());
+}
+
+TEST(pdf_parser, helper_processes_match_in_process)
+{
+    auto parse = [](const std::string& file_name, pdf::helper_processes helper_processes)
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{file_name} |
+            content_type::by_file_extension::detector{} |
+            pdf_parser{pdf::pages{}, pdf::metadata_only{false}, helper_processes} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    const std::vector<std::string> file_names { "1.pdf", "2.pdf", "3.pdf", "4.pdf", "multi_pages_1.pdf" };
+    std::vector<std::future<std::string>> helper_outputs;
+    for (const std::string& file_name : file_names)
+        helper_outputs.push_back(std::async(std::launch::async, parse, file_name, pdf::helper_processes{2}));
+    for (size_t i = 0; i < file_names.size(); ++i)
+        EXPECT_EQ(helper_outputs[i].get(), parse(file_names[i], pdf::helper_processes{0})) << file_names[i];
+}
+
+TEST(ocr_parser, parallel_recognition_keeps_image_order)
+{
+    auto parse = [](ocr_concurrency concurrency)
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{"embedded_images.pdf"} |
+            content_type::by_file_extension::detector{} |
+            pdf_parser{} |
+            ocr_parser{{}, {}, {}, {}, concurrency} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    ASSERT_EQ(parse(ocr_concurrency{4}), parse(ocr_concurrency{1}));
+}
+
+TEST(ocr_parser, look_ahead_recognition_of_buffered_images)
+{
+    auto parse = [](ocr_concurrency concurrency)
+    {
+        // Streamers use the parser, so it has to outlive them.
+        ocr_parser parser{{}, {}, {}, {}, concurrency};
+        std::vector<message_ptr> messages;
+        std::filesystem::path{"embedded_images.pdf"} |
+            content_type::by_file_extension::detector{} |
+            pdf_parser{} |
+            parser |
+            messages;
+        std::string text;
+        auto collect = [&text](message_ptr msg)
+        {
+            if (msg->is<document::text>())
+                text += msg->get<document::text>().text;
+            return continuation::proceed;
+        };
+        for (const message_ptr& msg : messages)
+            if (msg->is<document::image>() && msg->get<document::image>().structured_content_streamer)
+                (*msg->get<document::image>().structured_content_streamer)(message_callbacks{collect, collect});
+        return text;
+    };
+    std::string sequential = parse(ocr_concurrency{1});
+    ASSERT_FALSE(sequential.empty());
+    ASSERT_EQ(parse(ocr_concurrency{4}), sequential);
+}
+
+// Parses every file once, then all of them several times at once, and compares the outputs.
+void expect_concurrent_parsing_matches_sequential(const std::vector<std::string>& file_names)
+{
+    auto parse = [](const std::string& file_name)
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{file_name} |
+            content_type::by_file_extension::detector{} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    std::vector<std::string> expected;
+    for (const std::string& file_name : file_names)
+        expected.push_back(parse(file_name));
+    constexpr int rounds = 4;
+    std::vector<std::future<std::string>> results;
+    for (int round = 0; round < rounds; round++)
+        for (const std::string& file_name : file_names)
+            results.push_back(std::async(std::launch::async, parse, file_name));
+    for (size_t i = 0; i < results.size(); i++)
+        EXPECT_EQ(results[i].get(), expected[i % file_names.size()]) << file_names[i % file_names.size()];
+}
+
+TEST(xls_parser, concurrent_parsing_matches_sequential)
+{
+    std::vector<std::string> file_names { "biff5.xls" };
+    for (int i = 1; i <= 9; i++)
+        file_names.push_back(std::to_string(i) + ".xls");
+    expect_concurrent_parsing_matches_sequential(file_names);
+}
+
+TEST(rtf_parser, concurrent_parsing_matches_sequential)
+{
+    std::vector<std::string> file_names { "hebrew_1.rtf", "hebrew_2.rtf", "special_para_cmds.rtf" };
+    for (int i = 1; i <= 9; i++)
+        file_names.push_back(std::to_string(i) + ".rtf");
+    expect_concurrent_parsing_matches_sequential(file_names);
+}
+
+TEST(doc_parser, concurrent_parsing_matches_sequential)
+{
+    std::vector<std::string> file_names { "embedded_spreadsheet.doc", "encoding_in_table.doc", "fields.doc", "header_footer.doc" };
+    for (int i = 1; i <= 9; i++)
+        file_names.push_back(std::to_string(i) + ".doc");
+    expect_concurrent_parsing_matches_sequential(file_names);
+}
+
+TEST(pst_parser, attachments_are_readable_after_parsing)
+{
+    data_source pst{std::filesystem::path{"1.pst"}};
+    content_type::detect(pst);
+    std::vector<size_t> attachment_sizes;
+    std::vector<data_source> attachments;
+    bool in_attachment = false;
+    pst_parser{}(std::make_shared<message<data_source>>(std::move(pst)), {
+        [&](message_ptr msg)
+        {
+            if (msg->is<mail::attachment>())
+            {
+                attachment_sizes.push_back(msg->get<mail::attachment>().size);
+                in_attachment = true;
+            }
+            else if (msg->is<mail::close_attachment>())
+                in_attachment = false;
+            return continuation::proceed;
+        },
+        [&](message_ptr msg)
+        {
+            if (in_attachment && msg->is<data_source>())
+                attachments.push_back(std::move(msg->get<data_source>()));
+            return continuation::proceed;
+        }
+    });
+    // Attachment data is read lazily, so it has to stay readable after the parser returns
+    ASSERT_FALSE(attachments.empty());
+    ASSERT_EQ(attachments.size(), attachment_sizes.size());
+    for (size_t i = 0; i < attachments.size(); i++)
+        EXPECT_EQ(attachments[i].span().size(), attachment_sizes[i]);
+}
+
+TEST(pst_parser, parallel_parsing_matches_sequential)
+{
+    auto parse = [](pst_parallelism parallelism)
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{"1.pst"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{parallelism} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    auto sorted_lines = [](const std::string& text)
+    {
+        std::vector<std::string> lines;
+        boost::split(lines, text, boost::is_any_of("\n"));
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    };
+    std::string sequential = parse(pst_parallelism{});
+    EXPECT_EQ(parse(pst_parallelism{.concurrency = 4}), sequential);
+    EXPECT_EQ(sorted_lines(parse(pst_parallelism{.concurrency = 4, .ordered = false})), sorted_lines(sequential));
+}
+
+TEST(pst_parser, filter_pushdown_matches_standard_filters)
+{
+    const std::vector<std::string> folder_names { "Najwyższy poziom pliku danych programu Outlook", "Skrzynka odbiorcza" };
+    const std::vector<file_extension> attachment_types { file_extension{".pdf"} };
+    std::ostringstream filtered_output{};
+    std::filesystem::path{"1.pst"} |
+        content_type::by_file_extension::detector{} |
+        mail_parser{} |
+        standard_filter::filterByFolderName(folder_names) |
+        standard_filter::filterByAttachmentType(attachment_types) |
+        office_formats_parser{} |
+        plain_text_exporter() |
+        filtered_output;
+    std::ostringstream pushdown_output{};
+    std::filesystem::path{"1.pst"} |
+        content_type::by_file_extension::detector{} |
+        mail_parser{pst_parallelism{}, mail_filter{.folder_names = folder_names, .attachment_types = attachment_types}} |
+        office_formats_parser{} |
+        plain_text_exporter() |
+        pushdown_output;
+    EXPECT_EQ(pushdown_output.str(), filtered_output.str());
+    EXPECT_NE(pushdown_output.str().find("Skrzynka odbiorcza"), std::string::npos);
+    EXPECT_EQ(pushdown_output.str().find("1DAEC~1.HTM"), std::string::npos);
+}
+
+TEST(pst_parser, creation_time_pushdown_matches_standard_filters)
+{
+    // Both html mails of 1.pst were created at 2021-12-06 11:37:31 UTC
+    const unsigned int creation_time = 1638790651;
+    auto expect_pushdown_matches = [](unsigned int min_time, unsigned int max_time)
+    {
+        std::ostringstream filtered_output{};
+        std::filesystem::path{"1.pst"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{} |
+            standard_filter::filterByMailMinCreationTime(min_time) |
+            standard_filter::filterByMailMaxCreationTime(max_time) |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            filtered_output;
+        std::ostringstream pushdown_output{};
+        std::filesystem::path{"1.pst"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{pst_parallelism{}, mail_filter{.min_creation_time = min_time, .max_creation_time = max_time}} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            pushdown_output;
+        EXPECT_EQ(pushdown_output.str(), filtered_output.str());
+        return pushdown_output.str();
+    };
+    EXPECT_NE(expect_pushdown_matches(creation_time - 60, creation_time + 60).find("mail: Pierwszy html"), std::string::npos);
+    EXPECT_EQ(expect_pushdown_matches(creation_time - 60, creation_time - 1).find("mail: "), std::string::npos);
+    EXPECT_EQ(expect_pushdown_matches(creation_time + 1, creation_time + 60).find("mail: "), std::string::npos);
+}
+
+TEST(eml_parser, attachment_type_pushdown_matches_standard_filter)
+{
+    auto expect_pushdown_matches = [](const std::vector<file_extension>& attachment_types)
+    {
+        std::ostringstream filtered_output{};
+        std::filesystem::path{"fourth.eml"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{} |
+            standard_filter::filterByAttachmentType(attachment_types) |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            filtered_output;
+        std::ostringstream pushdown_output{};
+        std::filesystem::path{"fourth.eml"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{pst_parallelism{}, mail_filter{.attachment_types = attachment_types}} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            pushdown_output;
+        EXPECT_EQ(pushdown_output.str(), filtered_output.str());
+        return pushdown_output.str();
+    };
+    std::string unfiltered = expect_pushdown_matches({ file_extension{".xlsx"} });
+    std::string filtered = expect_pushdown_matches({ file_extension{".pdf"} });
+    EXPECT_NE(filtered.find("testy"), std::string::npos);
+    EXPECT_LT(filtered.size(), unfiltered.size());
+}
+
+TEST(eml_parser, creation_time_pushdown)
+{
+    // fourth.eml is dated Sat, 02 Nov 2013 04:11:40 +0100.
+    // eml_parser emits no mail::mail, so the standard_filter time filters cannot skip it and the whole document is compared instead.
+    const unsigned int creation_time = 1383361900;
+    auto parse = [](const mail_filter& filter)
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{"fourth.eml"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{pst_parallelism{}, filter} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    std::string unfiltered = parse(mail_filter{});
+    ASSERT_NE(unfiltered.find("testy"), std::string::npos);
+    EXPECT_EQ(parse(mail_filter{.min_creation_time = creation_time, .max_creation_time = creation_time}), unfiltered);
+    EXPECT_EQ(parse(mail_filter{.min_creation_time = creation_time + 1}), "");
+    EXPECT_EQ(parse(mail_filter{.max_creation_time = creation_time - 1}), "");
+}
+
+TEST(pst_parser, checkpoint_skips_processed_mails)
+{
+    std::filesystem::path checkpoint_path = std::filesystem::temp_directory_path() /
+        ("pst_parser_checkpoint_" + std::to_string(std::random_device{}()) + ".txt");
+    std::filesystem::remove(checkpoint_path);
+    auto parse = [&checkpoint_path]()
+    {
+        std::ostringstream output_stream{};
+        std::filesystem::path{"1.pst"} |
+            content_type::by_file_extension::detector{} |
+            mail_parser{pst_parallelism{}, mail_filter{}, std::make_shared<file_mail_checkpoint_store>(checkpoint_path)} |
+            office_formats_parser{} |
+            plain_text_exporter() |
+            output_stream;
+        return output_stream.str();
+    };
+    std::string first_run = parse();
+    EXPECT_NE(first_run.find("mail: Pierwszy html"), std::string::npos);
+    std::string resumed_run = parse();
+    EXPECT_EQ(resumed_run.find("mail: "), std::string::npos);
+    EXPECT_NE(resumed_run.find("folder: Skrzynka odbiorcza"), std::string::npos);
+    std::filesystem::remove(checkpoint_path);
+}
+
+TEST(pst_parser, checkpoint_skips_failed_and_skipped_mails)
+{
+    struct memory_checkpoint_store : mail_checkpoint_store
+    {
+        std::set<std::uint32_t> identifiers;
+        bool contains(std::uint32_t identifier) const override { return identifiers.contains(identifier); }
+        void commit(std::uint32_t identifier) override { identifiers.insert(identifier); }
+    };
+    auto parse = [](std::shared_ptr<memory_checkpoint_store> store, continuation mail_response)
+    {
+        data_source pst{std::filesystem::path{"1.pst"}};
+        content_type::detect(pst);
+        std::set<std::uint32_t> mails;
+        std::set<std::uint32_t> mails_with_attachments;
+        std::optional<std::uint32_t> current_mail;
+        bool in_attachment = false;
+        pst_parser{pst_parallelism{}, mail_filter{}, store}(std::make_shared<message<data_source>>(std::move(pst)), {
+            [&](message_ptr msg)
+            {
+                if (msg->is<mail::mail>())
+                {
+                    current_mail = msg->get<mail::mail>().identifier;
+                    if (current_mail)
+                        mails.insert(*current_mail);
+                    return mail_response;
+                }
+                if (msg->is<mail::attachment>())
+                {
+                    in_attachment = true;
+                    if (current_mail)
+                        mails_with_attachments.insert(*current_mail);
+                }
+                else if (msg->is<mail::close_attachment>())
+                    in_attachment = false;
+                return continuation::proceed;
+            },
+            [&](message_ptr msg)
+            {
+                if (in_attachment && msg->is<data_source>())
+                    throw std::runtime_error("Attachment processing failed");
+                return continuation::proceed;
+            }
+        });
+        return std::make_pair(mails, mails_with_attachments);
+    };
+
+    auto store = std::make_shared<memory_checkpoint_store>();
+    auto [mails, mails_with_attachments] = parse(store, continuation::proceed);
+    ASSERT_FALSE(mails_with_attachments.empty());
+    for (std::uint32_t identifier : mails)
+        EXPECT_EQ(store->contains(identifier), !mails_with_attachments.contains(identifier)) << identifier;
+    // Mails with failed attachments are processed again by the next run.
+    EXPECT_EQ(parse(store, continuation::proceed).first, mails_with_attachments);
+
+    auto skipping_store = std::make_shared<memory_checkpoint_store>();
+    ASSERT_FALSE(parse(skipping_store, continuation::skip).first.empty());
+    EXPECT_TRUE(skipping_store->identifiers.empty());
+}
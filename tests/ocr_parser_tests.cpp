@@ -10,11 +10,18 @@
 /*********************************************************************************************************************************************/
 
 #include "contains_type.h" // IWYU pragma: keep
+#include "document_elements.h"
 #include "error_tags.h"
 #include "message_matchers.h" // IWYU pragma: keep
 #include "ocr_parser.h"
 #include "input.h"
 #include "output.h"
+#include "plain_text_exporter.h"
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
 
 using namespace docwire;
 using namespace testing;
@@ -36,3 +43,235 @@ TEST(ocr_parser, leptonica_stderr_capturer)
             "with context \"leptonica_stderr_capturer.contents(): Error in pixReadMem: Unknown format: no pix returned\""));
     }
 }
+
+TEST(ocr_parser, reusing_pooled_engines)
+{
+    auto parse = []()
+    {
+        std::ostringstream output;
+        data_source{std::filesystem::path{"basic_ocr-eng.png"}, mime_type{"image/png"}, confidence::highest} |
+            ocr_parser{} | plain_text_exporter{} | output;
+        return output.str();
+    };
+    std::string first_output = parse();
+    ASSERT_FALSE(first_output.empty());
+    // Second recognition reuses the engine returned to the pool and must not see results of the first one.
+    ASSERT_EQ(parse(), first_output);
+}
+
+TEST(ocr_parser, prefilter_skips_blank_and_small_images)
+{
+    auto gray_image = [](int width, int height)
+    {
+        raster_image raster{
+            .pixels = std::make_shared<const std::vector<std::byte>>(static_cast<size_t>(width) * height, std::byte{0xff}),
+            .width = width, .height = height, .stride = width, .format = pixel_format::gray8,
+            .horizontal_dpi = 300, .vertical_dpi = 300
+        };
+        return std::make_shared<message<document::image>>(document::image{
+            .source = data_source{std::string{}, mime_type{"image/png"}, confidence::highest},
+            .raster = [raster]() { return raster; }
+        });
+    };
+    ocr_parser parser{{}, {}, {}, {}, ocr_concurrency{1}, ocr_prefilter{.enabled = true}};
+    std::vector<message_ptr> output;
+    auto collect = [&output](message_ptr msg) { output.push_back(msg); return continuation::proceed; };
+    message_callbacks callbacks{collect, collect};
+    for (message_ptr image : {gray_image(200, 200), gray_image(5, 200)})
+    {
+        parser(image, callbacks);
+        ASSERT_TRUE(image->get<document::image>().structured_content_streamer);
+        (*image->get<document::image>().structured_content_streamer)(callbacks);
+    }
+    ASSERT_THAT(output, Not(Contains(Pointee(Property(&message_base::is<document::text>, true)))));
+    ocr_prefilter_statistics statistics = parser.prefilter_statistics();
+    EXPECT_EQ(statistics.recognized, 0);
+    EXPECT_EQ(statistics.skipped_blank, 1);
+    EXPECT_EQ(statistics.skipped_too_small, 1);
+}
+
+namespace
+{
+
+// Decodes basic_ocr-eng.bmp (uncompressed 24-bit, bottom-up), magnified and repeated in columns separated by
+// white space as wide as a column. Resolution is declared as of a 288 DPI scan, magnified.
+raster_image basic_ocr_raster(int magnification, int columns = 1)
+{
+    std::ifstream bmp_file{"basic_ocr-eng.bmp", std::ios::binary};
+    std::vector<char> bmp{std::istreambuf_iterator<char>{bmp_file}, std::istreambuf_iterator<char>{}};
+    constexpr size_t bmp_header_size = 54;
+    constexpr int bmp_width = 561;
+    constexpr int bmp_height = 136;
+    constexpr int bmp_stride = (bmp_width * 3 + 3) / 4 * 4;
+    if (bmp.size() < bmp_header_size + static_cast<size_t>(bmp_stride) * bmp_height)
+        throw std::runtime_error("Unexpected size of basic_ocr-eng.bmp");
+    const int column_width = bmp_width * magnification;
+    raster_image raster{
+        .width = column_width * (2 * columns - 1), .height = bmp_height * magnification, .stride = column_width * (2 * columns - 1) * 3,
+        .format = pixel_format::bgr24, .horizontal_dpi = 288 * magnification, .vertical_dpi = 288 * magnification
+    };
+    auto pixels = std::make_shared<std::vector<std::byte>>(static_cast<size_t>(raster.stride) * raster.height, std::byte{0xff});
+    for (int column = 0; column < columns; ++column)
+        for (int y = 0; y < raster.height; ++y)
+            for (int x = 0; x < column_width; ++x)
+                for (int channel = 0; channel < 3; ++channel)
+                    (*pixels)[static_cast<size_t>(y) * raster.stride + (2 * column * column_width + x) * 3 + channel] = static_cast<std::byte>(
+                        bmp[bmp_header_size + static_cast<size_t>(bmp_height - 1 - y / magnification) * bmp_stride + x / magnification * 3 + channel]);
+    raster.pixels = pixels;
+    return raster;
+}
+
+std::string recognize_raster(ocr_parser& parser, const raster_image& raster)
+{
+    message_ptr image = std::make_shared<message<document::image>>(document::image{
+        .source = data_source{std::string{}, mime_type{"image/bmp"}, confidence::highest},
+        .raster = [raster]() { return raster; }
+    });
+    std::string text;
+    auto collect = [&text](message_ptr msg)
+    {
+        if (msg->is<document::text>())
+            text += msg->get<document::text>().text;
+        return continuation::proceed;
+    };
+    message_callbacks callbacks{collect, collect};
+    parser(image, callbacks);
+    (*image->get<document::image>().structured_content_streamer)(callbacks);
+    return text;
+}
+
+} // anonymous namespace
+
+TEST(ocr_parser, downscaling_oversized_images)
+{
+    raster_image raster = basic_ocr_raster(4);
+    auto recognize = [&raster](ocr_downscaling downscaling)
+    {
+        ocr_parser parser{{}, {}, {}, {}, ocr_concurrency{1}, ocr_prefilter{}, downscaling};
+        return recognize_raster(parser, raster);
+    };
+    // Downscaled back to the original pixels and still recognized.
+    EXPECT_THAT(recognize(ocr_downscaling{.target_dpi = 288}), HasSubstr("Testing OCR parser."));
+    // A limit too low to keep any text shows that the limits are applied at all.
+    EXPECT_THAT(recognize(ocr_downscaling{.max_pixels = 1000}), Not(HasSubstr("Testing")));
+}
+
+TEST(ocr_parser, region_parallel_recognition_matches_sequential)
+{
+    raster_image raster = basic_ocr_raster(1, 3);
+    auto recognize = [&raster](ocr_region_parallelism region_parallelism)
+    {
+        ocr_parser parser{{}, {}, {}, {}, ocr_concurrency{1}, ocr_prefilter{}, ocr_downscaling{}, ocr_result_cache{}, region_parallelism};
+        return recognize_raster(parser, raster);
+    };
+    std::string sequential = recognize(ocr_region_parallelism{});
+    ASSERT_THAT(sequential, HasSubstr("Testing OCR parser."));
+    EXPECT_EQ(recognize(ocr_region_parallelism{.concurrency = 3, .min_pixels = 0}), sequential);
+}
+
+TEST(ocr_parser, concurrent_recognition_of_images_read_one_by_one)
+{
+    raster_image raster = basic_ocr_raster(1);
+    std::mutex mutex;
+    std::condition_variable running_changed;
+    int running = 0;
+    int max_running = 0;
+    // Pixels are provided in the recognition thread, so each provider waits a while for the other one to start.
+    auto image = [&]()
+    {
+        return std::make_shared<message<document::image>>(document::image{
+            .source = data_source{std::string{}, mime_type{"image/bmp"}, confidence::highest},
+            .raster = [&]()
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                max_running = std::max(max_running, ++running);
+                running_changed.notify_all();
+                running_changed.wait_for(lock, std::chrono::seconds{10}, [&]() { return running >= 2; });
+                --running;
+                return raster;
+            }
+        });
+    };
+    ocr_parser parser{{}, {}, {}, {}, ocr_concurrency{2}};
+    std::string text;
+    std::function<continuation(message_ptr)> collect = [&text, &collect](message_ptr msg)
+    {
+        // Images are read as they come, like exporters do.
+        if (msg->is<document::image>() && msg->get<document::image>().structured_content_streamer)
+            (*msg->get<document::image>().structured_content_streamer)(message_callbacks{collect, collect});
+        else if (msg->is<document::text>())
+            text += msg->get<document::text>().text;
+        return continuation::proceed;
+    };
+    message_callbacks callbacks{collect, collect};
+    parser(std::make_shared<message<document::document>>(document::document{.metadata = []() { return attributes::metadata{}; }}), callbacks);
+    parser(image(), callbacks);
+    parser(image(), callbacks);
+    parser(std::make_shared<message<document::close_document>>(document::close_document{}), callbacks);
+    EXPECT_EQ(max_running, 2);
+    std::string::size_type first = text.find("Testing OCR parser.");
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_NE(text.find("Testing OCR parser.", first + 1), std::string::npos);
+}
+
+TEST(ocr_parser, result_cache_directory)
+{
+    std::filesystem::path cache_directory = std::filesystem::temp_directory_path() /
+        ("docwire_ocr_result_cache_" + std::to_string(std::random_device{}()));
+    std::filesystem::remove_all(cache_directory);
+    // Results are not kept in memory, so the second parse reads the file written by the first one.
+    auto parse = [&cache_directory]()
+    {
+        std::ostringstream output;
+        data_source{std::filesystem::path{"basic_ocr-eng.png"}, mime_type{"image/png"}, confidence::highest} |
+            ocr_parser{{}, {}, {}, {}, ocr_concurrency{1}, ocr_prefilter{}, ocr_downscaling{},
+                ocr_result_cache{.enabled = true, .directory = cache_directory, .in_memory = false}} |
+            plain_text_exporter{} | output;
+        return output.str();
+    };
+    std::string first_output = parse();
+    ASSERT_THAT(first_output, HasSubstr("Testing OCR parser."));
+    std::vector<std::filesystem::path> cache_files{std::filesystem::directory_iterator{cache_directory}, std::filesystem::directory_iterator{}};
+    ASSERT_EQ(cache_files.size(), 1u);
+    ASSERT_EQ(parse(), first_output);
+    // Text of the same size changed in the file shows that the result comes from the file and not from recognition.
+    std::string contents;
+    {
+        std::ifstream file{cache_files.front(), std::ios::binary};
+        contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    }
+    std::string::size_type text_position = contents.find("Testing");
+    ASSERT_NE(text_position, std::string::npos);
+    contents.replace(text_position, 7, "Tasting");
+    std::ofstream{cache_files.front(), std::ios::binary | std::ios::trunc} << contents;
+    EXPECT_THAT(parse(), HasSubstr("Tasting OCR parser."));
+    std::filesystem::remove_all(cache_directory);
+}
+
+TEST(ocr_parser, multi_page_tiff)
+{
+    // The second file holds 1 bpp pages compressed with CCITT G4, like fax scans.
+    for (const char* file_name : {"multi_page_ocr-eng.tiff", "multi_page_fax_ocr-eng.tiff"})
+    for (unsigned int concurrency : {1u, 2u})
+    {
+        std::vector<message_ptr> output;
+        data_source{std::filesystem::path{file_name}, mime_type{"image/tiff"}, confidence::highest} |
+            ocr_parser{{}, {}, {}, {}, ocr_concurrency{concurrency}} | output;
+        std::vector<size_t> page_indexes;
+        for (size_t i = 0; i < output.size(); ++i)
+            if (output[i]->is<document::page>())
+                page_indexes.push_back(i);
+        ASSERT_EQ(page_indexes.size(), 2) << file_name << ", concurrency " << concurrency;
+        ASSERT_TRUE(output[page_indexes[1] - 1]->is<document::close_page>());
+        auto page_text = [&output](size_t from)
+        {
+            std::string text;
+            for (size_t i = from; !output[i]->is<document::close_page>(); ++i)
+                if (output[i]->is<document::text>())
+                    text += output[i]->get<document::text>().text;
+            return text;
+        };
+        EXPECT_THAT(page_text(page_indexes[0]), HasSubstr("Testing OCR parser.")) << file_name;
+        EXPECT_EQ(page_text(page_indexes[0]), page_text(page_indexes[1]));
+    }
+}
@@ -108,3 +108,34 @@ TEST(txt_parser, paragraphs)
         MessagePtrWith<document::close_document>(_)
     ));    
 }
+
+TEST(txt_parser, lines_spanning_conversion_chunks)
+{
+    std::vector<message_ptr> msgs;
+    std::string long_line(256 * 1024 - 1, 'a');
+    docwire::data_source{long_line + "\r\nLast line", mime_type{"text/plain"}, confidence::highest} |
+        txt_parser{} | msgs;
+    ASSERT_THAT(msgs, ElementsAre(
+        MessagePtrWith<document::document>(_),
+        MessagePtrWith<document::paragraph>(_),
+        MessagePtrWith<document::text>(Field(&document::text::text, StrEq(long_line))),
+        MessagePtrWith<document::break_line>(_),
+        MessagePtrWith<document::text>(Field(&document::text::text, StrEq("Last line"))),
+        MessagePtrWith<document::close_paragraph>(_),
+        MessagePtrWith<document::close_document>(_)
+    ));
+}
+
+TEST(txt_parser, non_ascii_text_after_detection_sample)
+{
+    std::vector<message_ptr> msgs;
+    std::string ascii_prefix(1024 * 1024 + 1, 'a');
+    std::string non_ascii_suffix {"Zażółć gęślą jaźń"};
+    docwire::data_source{ascii_prefix + non_ascii_suffix, mime_type{"text/plain"}, confidence::highest} |
+        txt_parser{parse_paragraphs{false}, parse_lines{false}} | msgs;
+    ASSERT_THAT(msgs, ElementsAre(
+        MessagePtrWith<document::document>(_),
+        MessagePtrWith<document::text>(Field(&document::text::text, EndsWith(non_ascii_suffix))),
+        MessagePtrWith<document::close_document>(_)
+    ));
+}